@@ -0,0 +1,156 @@
+#!/bin/bash
+#
+# Benchmark dos solvers sobre um conjunto de instâncias
+#
+# Compila eternity.c e done.c e roda, sobre cada instância, as variantes:
+#   serial     eternity (solver sequencial de referência)
+#   base       done com 1 processo e 1 thread (base do speedup)
+#   threads    done com 1 processo e T threads, para cada T de -t
+#   mpi        done com P processos e 1 thread, para cada P de -p
+#   hibrido    done com P processos e T threads (só com -h)
+# Cada variante roda -w vezes sem medir (aquecimento) e -r vezes medindo o
+# tempo de parede, que inclui o lançamento do mpirun. Execuções que excedem
+# o limite (-T) ou terminam com status maior que 1 (1 é "sem solução") ficam
+# fora das medianas, com um aviso no stderr. A saída padrão recebe
+# o CSV com a mediana de cada variante; o stderr, o progresso e uma tabela
+# legível.
+#
+# Colunas do CSV: instancia, variante, processos, threads, repeticoes,
+#   mediana_s, nos, nos_por_s, speedup, eficiencia
+#   repeticoes conta só as execuções medidas que terminaram (sem nenhuma, as
+#   demais colunas ficam vazias); nos e nos_por_s são as medianas dos
+#   contadores impressos pelo done (vazios para o serial); speedup e
+#   eficiência são relativos à variante base da mesma instância
+#
+# Com a busca pela primeira solução, o trabalho total muda com a divisão e a
+# ordem em que as unidades são visitadas, e speedups superlineares (ou
+# abaixo de 1) são esperados; para medir escalabilidade, passe -a -c, que
+# percorre a árvore inteira.
+#
+# Uso: ./benchmark.sh [-r repetições] [-w aquecimentos] [-p "2 4"] [-t "2 4"]
+#                     [-h] [-a "opções do done"] [-T segundos] [instâncias...]
+#   padrão: 3 repetições, 1 aquecimento, -p "2 4", -t "2 4", limite de 600 s
+#   por execução e as instâncias de entradas/
+#   MPIRUN (padrão mpirun) e MPIRUN_FLAGS (ex.: --oversubscribe) definem o
+#   lançador; instâncias maiores podem ser geradas com gerador.c
+#
+# Exemplo: ./benchmark.sh -r 5 -a "-o espiral" entradas/0[4-6].in > res.csv
+#
+
+REPS=3
+WARMUP=1
+PROCS="2 4"
+THREADS="2 4"
+HYBRID=0
+DONE_ARGS=""
+LIMIT=600
+
+while getopts "r:w:p:t:ha:T:" opt; do
+    case $opt in
+        r) REPS=$OPTARG ;;
+        w) WARMUP=$OPTARG ;;
+        p) PROCS=$OPTARG ;;
+        t) THREADS=$OPTARG ;;
+        h) HYBRID=1 ;;
+        a) DONE_ARGS=$OPTARG ;;
+        T) LIMIT=$OPTARG ;;
+        *) sed -n '/^# Uso:/,/^#$/p' "$0" >&2; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+DIR=$(cd "$(dirname "$0")" && pwd)
+if [ $# -gt 0 ]; then
+    INSTANCES=("$@")
+else
+    INSTANCES=("$DIR"/entradas/*.in)
+fi
+MPIRUN=${MPIRUN:-mpirun}
+
+BUILD=$(mktemp -d)
+trap 'rm -rf "$BUILD"' EXIT
+gcc -O2 -o "$BUILD/eternity" "$DIR/eternity.c" || exit 1
+mpicc -O2 -fopenmp -o "$BUILD/done" "$DIR/done.c" || exit 1
+
+# Mediana dos números da entrada padrão (vazio se não houver nenhum)
+mediana() {
+    sort -g | awk '{ v[NR] = $1 } END {
+        if (NR == 0) exit
+        if (NR % 2) print v[(NR + 1) / 2]; else print (v[NR / 2] + v[NR / 2 + 1]) / 2 }'
+}
+
+# Roda uma execução e imprime "status segundos nós" (nós vazio se não
+# informado)
+executa() {
+    local instance=$1 procs=$2 threads=$3 out="$BUILD/saida.txt"
+    local start=$(date +%s%N)
+    if [ "$procs" = 0 ]; then
+        timeout "$LIMIT" "$BUILD/eternity" < "$instance" > "$out" 2>&1
+    else
+        timeout "$LIMIT" $MPIRUN $MPIRUN_FLAGS -np "$procs" "$BUILD/done" -t "$threads" \
+            $DONE_ARGS < "$instance" > "$out" 2>&1
+    fi
+    local status=$?
+    local end=$(date +%s%N)
+    if [ $status = 124 ]; then
+        echo "  limite de $LIMIT s excedido: execução descartada" >&2
+    elif [ $status -gt 1 ]; then
+        echo "  terminou com status $status: execução descartada" >&2
+    fi
+    local nodes=$(grep -a '^Nós visitados:' "$out" | awk '{ print $3 }')
+    echo "$status $(awk -v a="$start" -v b="$end" 'BEGIN { printf "%.6f", (b - a) / 1e9 }') $nodes"
+}
+
+# Mede uma variante e deixa sua linha do CSV em LINE (roda no shell
+# principal para que BASE, a mediana da variante base, persista)
+mede() {
+    local instance=$1 variant=$2 procs=$3 threads=$4
+    local times="" nodes="" rates="" valid=0
+    for ((i = 0; i < WARMUP; i++)); do executa "$instance" "$procs" "$threads" > /dev/null; done
+    for ((i = 0; i < REPS; i++)); do
+        read status t n < <(executa "$instance" "$procs" "$threads")
+        [ "$status" -gt 1 ] && continue
+        valid=$((valid + 1))
+        times+="$t"$'\n'
+        if [ -n "$n" ]; then
+            nodes+="$n"$'\n'
+            rates+=$(awk -v n="$n" -v t="$t" 'BEGIN { printf "%.0f", n / t }')$'\n'
+        fi
+    done
+    local median=$(printf "%s" "$times" | mediana)
+    local median_nodes=$(printf "%s" "$nodes" | mediana)
+    local median_rate=$(printf "%s" "$rates" | mediana)
+    if [ "$variant" = base ]; then BASE=$median; fi
+    local speedup="" efficiency=""
+    if [ -n "$BASE" ] && [ -n "$median" ] && [ "$procs" != 0 ]; then
+        speedup=$(awk -v b="$BASE" -v t="$median" 'BEGIN { printf "%.3f", b / t }')
+        efficiency=$(awk -v s="$speedup" -v w=$((procs * threads)) 'BEGIN { printf "%.3f", s / w }')
+    fi
+    [ "$procs" = 0 ] && procs=1
+    LINE="$(basename "$instance"),$variant,$procs,$threads,$valid,$median,$median_nodes,$median_rate,$speedup,$efficiency"
+}
+
+echo "instancia,variante,processos,threads,repeticoes,mediana_s,nos,nos_por_s,speedup,eficiencia" |
+    tee "$BUILD/resultados.csv"
+for instance in "${INSTANCES[@]}"; do
+    BASE=""
+    variants=("base 1 1")
+    [ -z "$DONE_ARGS" ] && variants=("serial 0 1" "${variants[@]}")
+    for t in $THREADS; do [ "$t" -gt 1 ] && variants+=("threads 1 $t"); done
+    for p in $PROCS; do [ "$p" -gt 1 ] && variants+=("mpi $p 1"); done
+    if [ $HYBRID = 1 ]; then
+        for p in $PROCS; do for t in $THREADS; do
+            [ "$p" -gt 1 ] && [ "$t" -gt 1 ] && variants+=("hibrido $p $t")
+        done; done
+    fi
+    for v in "${variants[@]}"; do
+        set -- $v
+        echo "$(basename "$instance"): $1 ($((${2} > 0 ? ${2} : 1)) processos x ${3} threads)" >&2
+        mede "$instance" "$1" "$2" "$3"
+        echo "$LINE" | tee -a "$BUILD/resultados.csv"
+    done
+done
+
+# Tabela legível no stderr
+echo >&2
+column -t -s, "$BUILD/resultados.csv" >&2 2>/dev/null || cat "$BUILD/resultados.csv" >&2
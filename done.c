@@ -6,10 +6,69 @@
  * de paralelização baseada em peças de quina diferentes.
  * 
  * Estratégia de paralelização:
- * 1. Identifica todas as peças que podem ser colocadas nas quinas
- * 2. Distribui quinas diferentes para processos MPI diferentes
- * 3. Cada processo tenta resolver o puzzle com sua quina específica
- * 4. Comunicação assíncrona para parada antecipada quando solução é encontrada
+ * 1. Identifica as peças de quina e fixa uma delas (a quina canônica) na
+ *    quina superior esquerda: toda solução é a rotação de exatamente uma
+ *    solução com essa peça ali, o que corta 3/4 do espaço de busca
+ *    Da mesma forma, peças idênticas a menos de rotação e rotações com as
+ *    mesmas cores só são tentadas uma vez (exceto com -e); -c multiplica a
+ *    contagem de volta (ver agrupa_copias)
+ * 2. O processo 0 gera unidades de trabalho (prefixos das primeiras células)
+ * 3. Os processos pedem unidades sob demanda ao processo 0
+ * 4. Dentro de cada processo, -t threads dividem cada unidade por roubo de
+ *    trabalho (compilar com -fopenmp; sem OpenMP a busca é sequencial)
+ * 5. Parada antecipada sem fan-out: quem encontra solução avisa apenas o
+ *    processo 0, que anuncia o vencedor a todos com um MPI_Ibcast; o fim
+ *    das mensagens pendentes é detectado com MPI_Issend + MPI_Ibarrier
+ *
+ * Uso: mpirun -np P ./done [-n] [-t threads] [-f] [-o ordem] [-c | -e arquivo | -p] [-r]
+ *        [-d] [-m MiB] [-g células] [-l segundos] [--progress arquivo] < entrada
+ *      mpirun -np P ./done -a [-t cadeias] [-l segundos] [-s segundos] < entrada
+ *      mpirun -np P ./done -b [-t threads] [-f] [-o ordem] [-c [-r] | -p] [-d] [-m MiB]
+ *        [-l segundos] [arquivos...]
+ *   -f: poda por verificação adiante (contagem de cores das bordas abertas)
+ *   -o: ordem de visita das células: linha (padrão), moldura, espiral ou
+ *       mrv (a célula vazia com menos candidatos vivos)
+ *   -c: conta todas as soluções em vez de parar na primeira
+ *   -e: enumera todas as soluções, cada processo em arquivo.<rank>
+ *   -r: com -c/-e, inclui as 3 rotações de cada solução (sem -r, cada
+ *       solução é contada uma vez a menos de rotação)
+ *   -a: em vez do backtracking, recozimento simulado: uma cadeia por thread
+ *       de cada processo, até encontrar solução ou esgotar -l; sem
+ *       solução, imprime o tabuleiro com menos arestas não casadas
+ *   -p: se não encontrar solução, imprime o tabuleiro parcial mais fundo
+ *       alcançado por alguma thread de algum processo
+ *   -d: determinístico; sem quina canônica e com as unidades na ordem da
+ *       busca serial, imprime sempre a primeira solução dessa ordem (com
+ *       -o linha, a mesma do eternity.c), qualquer que seja o número de
+ *       processos e threads; não combina com -c/-e nem --resume
+ *   -g: completa as últimas células de cada tabuleiro no acelerador (OpenMP
+ *       target, um por processo do nó; sem acelerador, no hospedeiro): as
+ *       threads param na fronteira e enviam os prefixos em lotes (ver
+ *       descarrega_fronteira); só com -c ou em busca da primeira solução
+ *   -m: tabela de becos sem saída com até MiB de memória por processo:
+ *       estados (células preenchidas, peças restantes e cores das bordas
+ *       abertas) cuja subárvore já se esgotou sem solução não são buscados
+ *       de novo
+ *   -l: tempo limite, em segundos, da busca (no lote, de cada instância);
+ *       esgotado, a busca para como se a árvore tivesse acabado e, com -k,
+ *       grava um último checkpoint, mantido para a retomada
+ *   -k, --checkpoint arquivo: grava periodicamente em arquivo tudo o que
+ *       falta buscar (a cada -i/--checkpoint-interval segundos, padrão 60)
+ *   -s: relata em stderr, a cada segundos, os nós visitados por processo, e
+ *       imprime no fim o histograma de nós por profundidade
+ *   -n, --per-node: um único processo por nó busca, com as threads de
+ *       todos os processos do nó; os demais dormem (ver por_no)
+ *   -b: modo lote; resolve todas as instâncias dos arquivos dados (ou,
+ *       sem arquivos, as concatenadas na entrada padrão), cada uma por um
+ *       processo com suas threads, e imprime cada resultado ao terminar
+ *   --resume arquivo: retoma a busca de um checkpoint, com qualquer número
+ *       de processos e threads (as mesmas entrada e -o da execução original;
+ *       com -e, as soluções gravadas depois do último checkpoint se repetem)
+ *   --estimate: só divide a árvore para P processos e imprime a estimativa
+ *       de Knuth do número de nós (ver gera_unidades), sem buscar
+ *   --progress arquivo: escreve em arquivo, a cada --progress-interval
+ *       segundos (padrão 5), uma linha JSON com nós/s e profundidade
+ *       máxima de cada processo e as unidades na fila e em execução
 
  * Uso de IA para identificar peças de quina, para implementação do MPI_Iprobe
  * e para documentação do código pelo modelo Claude 4 sonnet
@@ -34,338 +93,4120 @@
 #include <string.h>
 #include <time.h>
 #include <sys/time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <limits.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 /* 
- * Estrutura que representa uma peça do puzzle
- * colors[4]: cores das 4 bordas (Norte, Leste, Sul, Oeste)
- * rotation: rotação atual da peça (0-3)
- * id: identificador único da peça
- * used: flag indicando se a peça já foi colocada no tabuleiro
+ * Estrutura que representa uma peça do puzzle, como lida da entrada
+ * colors[4]: cores das 4 bordas (Norte, Leste, Sul, Oeste) na rotação 0
+ * O identificador da peça é sua posição no array de peças.
  */
 typedef struct {
-    unsigned int colors[4];
-    unsigned char rotation;
-    unsigned int id;
-    int used;
+    unsigned char colors[4];
 } tile;
 
-/* 
- * Macros para acessar cores das bordas considerando rotação
- * X_COLOR: cor genérica da borda s considerando rotação
- * N_COLOR, E_COLOR, S_COLOR, W_COLOR: cores específicas das bordas
+/*
+ * Peça já rotacionada ("piece"): as 4 cores resolvidas para uma rotação,
+ * empacotadas um byte por lado em uma palavra de 32 bits:
+ *   N | E << 8 | S << 16 | W << 24
+ * Como ncolors < 256, cada comparação de borda vira uma comparação de byte,
+ * sem aritmética de módulo em tempo de busca.
+ */
+typedef unsigned int piece;
+
+/* 
+ * Macros para acessar cores das bordas de uma peça empacotada
+ * X_COLOR: cor genérica da borda s
+ * N_COLOR, E_COLOR, S_COLOR, W_COLOR: cores específicas das bordas
+ */
+#define PACK(n, e, s, w) ((piece)(n) | (piece)(e) << 8 | (piece)(s) << 16 | (piece)(w) << 24)
+#define X_COLOR(p, s) (((p) >> (8 * (s))) & 0xff)
+#define N_COLOR(p) (X_COLOR(p, 0))  // Norte
+#define E_COLOR(p) (X_COLOR(p, 1))  // Leste
+#define S_COLOR(p) (X_COLOR(p, 2))  // Sul
+#define W_COLOR(p) (X_COLOR(p, 3))  // Oeste
+
+/*
+ * Referência a uma peça rotacionada: id * 4 + rotação
+ * EMPTY marca uma célula vazia do tabuleiro
+ */
+#define PIECE_ID(ref) ((ref) >> 2)
+#define PIECE_ROT(ref) ((ref) & 3)
+#define EMPTY 0xffff
+
+/*
+ * O tabuleiro é cercado por um anel de células BORDER, cuja peça tem os
+ * 4 lados com cor 0: a regra da borda vira uma verificação de vizinho comum
+ * e os testes x == 0 / y == 0 / size-1 desaparecem.
+ */
+#define BORDER(g) (4 * (g)->tile_count)
+
+/*
+ * Função auxiliar para medição de tempo
+ * Retorna tempo atual em segundos com precisão de microssegundos
+ */
+double get_time() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*
+ * Conjuntos de peças rotacionadas são bitsets de words palavras de 64 bits
+ * em que o bit ref representa a referência ref (= id * 4 + rotação); as 4
+ * rotações de uma peça ficam sempre na mesma palavra
+ */
+#define WORD_BITS 64
+#define TILE_WORD(id) ((4 * (id)) / WORD_BITS)
+#define TILE_BITS(id) (0xfULL << ((4 * (id)) % WORD_BITS))
+
+/* Ordens de visita das células (-o) */
+#define ORDEM_LINHA 0
+#define ORDEM_MOLDURA 1
+#define ORDEM_ESPIRAL 2
+#define ORDEM_MRV 3
+
+/*
+ * Nível da pilha explícita de busca
+ * Os candidatos da célula preenchida nesta profundidade que ainda faltam
+ * testar são os bits de masks[depth] nas posições [next, end); cada
+ * candidato é uma referência, que já determina a rotação.
+ * O intervalo fica numa única palavra atômica (next | end << 24 | gen << 48)
+ * para que outra thread possa roubar a parte final [mid, end) com um CAS
+ * enquanto a dona consome a partir de next. gen muda a cada reabertura do
+ * nível, de modo que um CAS com uma leitura antiga sempre falha.
+ * Em conjunto, os níveis da pilha formam o deque de trabalho da thread: a
+ * dona trabalha no nível mais fundo e os ladrões tiram do mais raso.
+ */
+typedef struct {
+    _Atomic unsigned long long range;
+} frame;
+
+#define RANGE(n, e, gen) ((unsigned long long)(n) | (unsigned long long)(e) << 24 | \
+                          (unsigned long long)((gen) & 0xffff) << 48)
+#define R_NEXT(w) ((unsigned int)((w) & 0xffffff))
+#define R_END(w) ((unsigned int)(((w) >> 24) & 0xffffff))
+#define R_GEN(w) ((unsigned int)((w) >> 48))
+
+/*
+ * Verificação de parada durante a busca
+ * O intervalo em nós visitados se adapta para que as verificações ocorram
+ * a cada POLL_SECONDS, qualquer que seja o custo de um nó; POLL_INTERVAL é
+ * o intervalo inicial e o usado pelas threads ociosas
+ */
+#define POLL_INTERVAL 1000
+#define POLL_SECONDS 0.001
+#define POLL_MIN 64
+#define POLL_MAX (1 << 20)
+
+/*
+ * Tags das mensagens MPI
+ * TAG_PARADA: aviso de que uma solução foi encontrada
+ * TAG_PEDIDO: trabalhador ocioso pede uma unidade de trabalho ao processo 0,
+ *   informando as soluções que já encontrou
+ * TAG_TRABALHO: resposta com o registro de uma unidade de trabalho
+ * TAG_SEM_TRABALHO: resposta indicando que a fila de unidades acabou
+ * TAG_ESTADO: estado de um trabalhador para o checkpoint (soluções e níveis
+ *   pendentes das pilhas de suas threads)
+ * TAG_LOTE: resultado de uma instância do lote, que também pede a próxima
+ * TAG_INSTANCIA: instância do lote entregue a um processo
+ * TAG_PARCIAL: melhor tabuleiro parcial do processo que o alcançou (-p)
+ */
+#define TAG_PARADA 999
+#define TAG_PEDIDO 1000
+#define TAG_TRABALHO 1001
+#define TAG_SEM_TRABALHO 1002
+#define TAG_ESTADO 1003
+#define TAG_LOTE 1004
+#define TAG_INSTANCIA 1005
+#define TAG_PARCIAL 1006
+#define TAG_PROGRESSO 1007
+
+/* Tamanho do buffer de escrita de soluções de cada thread (-e) */
+#define SOLUTION_BUF (1 << 20)
+
+/* Tamanho do texto de uma contagem de soluções (ver formata_contagem) */
+#define COUNT_TEXT 48
+
+/* Número desejado de unidades de trabalho por processo */
+#define UNITS_PER_RANK 16
+
+/*
+ * Estimativa do tamanho das unidades (método de Knuth): sondagens por
+ * unidade, semente do sorteio (fixa, para que a divisão seja reproduzível),
+ * máximo de unidades por processo ao aprofundar a divisão e fração máxima
+ * da parte de um processo que uma unidade pode ter
+ */
+#define ESTIMATE_PROBES 16
+#define ESTIMATE_SEED 0x9e3779b97f4a7c15ULL
+#define UNITS_MAX_PER_RANK 64
+#define UNIT_SHARE 4
+
+/*
+ * Unidade de trabalho: registro de unsigned short [profundidade, início,
+ * fim, prefixo...] com as peças das primeiras profundidade células da ordem
+ * de visita e o intervalo [início, fim) de posições do bitset de candidatos
+ * da célula seguinte que falta explorar. As unidades geradas cobrem o
+ * bitset inteiro; as de um checkpoint, o que restava de um nível da pilha
+ * de alguma thread.
+ */
+#define UNIT_DEPTH(u) ((u)[0])
+#define UNIT_NEXT(u) ((u)[1])
+#define UNIT_END(u) ((u)[2])
+#define UNIT_PREFIX(u) ((u) + 3)
+#define UNIT_LEN(u) (3 + (u)[0])
+
+/*
+ * Tabela de becos sem saída (-m): entradas por balde (meia linha de cache)
+ * e mínimo de células por preencher para que um nó entre na tabela (abaixo
+ * disso, refazer a busca custa menos que consultá-la)
+ */
+#define CACHE_WAYS 4
+#define CACHE_MIN_CELLS 4
+
+/* Intervalo padrão entre checkpoints, em segundos (-i) */
+#define CHECKPOINT_SECONDS 60
+#define GPU_BATCH 4096             // Prefixos por lote enviado ao dispositivo (-g)
+#define PROGRESS_SECONDS 5         // Intervalo padrão do fluxo de progresso
+
+#define CHECKPOINT_MAGIC "ETCK"
+#define CHECKPOINT_VERSION 2
+
+/*
+ * Os últimos STEAL_CUTOFF níveis da pilha são privados: subárvores tão
+ * pequenas não compensam o roubo, e a dona evita o CAS nesses níveis
+ */
+#define STEAL_CUTOFF 6
+
+/*
+ * Tamanhos com núcleo de busca especializado (ver KERNEL); os demais usam
+ * o caminho genérico
+ */
+#define KERNEL_MIN 4
+#define KERNEL_MAX 16
+#define KERNEL_WORDS(n) ((4 * (n) * (n) + WORD_BITS - 1) / WORD_BITS)
+#define ALWAYS_INLINE static inline __attribute__((always_inline))
+
+/*
+ * Em x86-64, cada núcleo especializado também é gerado para AVX2, e a versão
+ * é escolhida pela CPU ao carregar o programa; em aarch64 o NEON já faz parte
+ * da base, sem -march
+ */
+#if defined(__x86_64__) && defined(__has_attribute)
+#if __has_attribute(target_clones)
+#define KERNEL_CLONES __attribute__((target_clones("avx2", "default")))
+#endif
+#endif
+#ifndef KERNEL_CLONES
+#define KERNEL_CLONES
+#endif
+
+/*
+ * Alinhamento de cada array da arena de uma thread: uma linha de cache,
+ * que também basta para as cargas vetoriais dos bitsets
+ */
+#define ARENA_ALIGN 64
+
+/*
+ * Recozimento simulado (-a): passos por época de cada cadeia entre as
+ * trocas do melhor tabuleiro, e probabilidade de aceitar um passo que
+ * descasa uma aresta a mais ao (re)aquecer, o fator aplicado a cada época
+ * e o valor abaixo do qual a cadeia reaquece
+ */
+#define SA_EPOCH (1 << 16)
+#define SA_HEAT 0.4
+#define SA_COOLING 0.97
+#define SA_HEAT_MIN 1e-4
+
+/*
+ * Estrutura principal do jogo
+ * size: dimensão do tabuleiro (size x size)
+ * tile_count: número total de peças (= size²)
+ * ncolors: maior cor válida nas bordas das peças
+ * stride: largura de uma linha do tabuleiro incluindo o anel (= size + 2)
+ * tiles: array com todas as peças disponíveis
+ * pieces: cores empacotadas de cada peça rotacionada, indexadas pela
+ *   referência, mais a peça BORDER com todos os lados 0
+ * offset: deslocamento no tabuleiro até o vizinho de cada lado
+ * words: palavras de cada bitset de referências
+ * side_mask: para cada lado e cor, o bitset das referências com essa cor
+ *   nesse lado (ver SIDE_MASK)
+ * ncells/order: células a preencher, na ordem estática de visita (com
+ *   -o mrv, apenas o conjunto de células percorrido a cada escolha)
+ * steal_limit: níveis da pilha abaixo deste podem ser roubados
+ * frontier: profundidade em que play() entrega o tabuleiro; ncells, ou,
+ *   com -g, a fronteira das subárvores completadas no dispositivo
+ * canon_tile: peça de quina fixada na quina superior esquerda (-1 se nenhuma)
+ * root_mask: candidatos da quina superior esquerda, restritos às rotações
+ *   de canon_tile
+ * distinct/next_copy: rotações que valem como candidatas e próxima peça
+ *   idêntica de cada peça (ver agrupa_copias)
+ * zobrist: com -m, chaves aleatórias do hash dos estados: uma por peça, uma
+ *   por célula e uma por aresta interna e cor (ver Z_TILE, atualiza_hash)
+ * Depois de construída, é somente leitura e compartilhada por todas as threads.
+ */
+typedef struct {
+    unsigned int size;
+    unsigned int tile_count;
+    unsigned int ncolors;
+    unsigned int stride;
+    int offset[4];
+    tile *tiles;
+    piece *pieces;
+    unsigned int words;
+    uint64_t *side_mask;
+    unsigned int ncells;
+    unsigned int *order;
+    unsigned int steal_limit;
+    unsigned int frontier;
+    int canon_tile;
+    uint64_t *root_mask;
+    uint64_t *distinct;
+    int *next_copy;
+    uint64_t *zobrist;
+} game;
+
+/*
+ * Contadores da busca de uma thread (ver STATS_COUNTERS)
+ * nodes: peças colocadas, isto é, nós visitados da árvore de busca
+ * candidates: candidatos tomados dos bitsets (já livres e compatíveis com
+ *   os vizinhos; o que antes eram as chamadas a valid_move() aprovadas)
+ * fc_rejects: candidatos rejeitados pela verificação adiante (-f)
+ * dead_ends: níveis abertos sem nenhum candidato (todas as peças livres
+ *   rejeitadas pelas cores dos vizinhos)
+ * steals: roubos de trabalho bem-sucedidos
+ * cache_hits: subárvores descartadas pela tabela de becos sem saída (-m)
+ * max_depth: maior número de células preenchidas ao mesmo tempo
+ */
+typedef struct {
+    unsigned long long nodes;
+    unsigned long long candidates;
+    unsigned long long fc_rejects;
+    unsigned long long dead_ends;
+    unsigned long long steals;
+    unsigned long long cache_hits;
+    unsigned long long max_depth;
+} counters;
+
+/* Contadores somados entre threads e processos (todos menos max_depth) */
+#define STATS_COUNTERS 6
+
+/*
+ * Estado de busca de uma thread
+ * id: número da thread no processo (a thread 0 é a única que usa MPI)
+ * board: array contíguo, linha por linha, de (size + 2)² referências
+ *   (id * 4 + rotação) das peças colocadas, incluindo o anel de BORDER;
+ *   EMPTY nas células livres
+ * avail: bitset das referências cujas peças ainda não foram colocadas
+ * order: order[d] é a célula preenchida na profundidade d (cópia da ordem
+ *   estática, ou escolhida ao abrir o nível com -o mrv)
+ * stack/depth: pilha explícita; stack[0..depth-1] têm peça colocada e
+ *   stack[depth] é o nível sendo explorado
+ * base: profundidade acima da qual a busca nunca retrocede
+ * masks: masks + d * words é o bitset de candidatos do nível d; scratch é
+ *   um bitset temporário
+ * steal_buf: cópia temporária do prefixo de uma vítima durante um roubo
+ * poll_nodes/last_poll: intervalo atual entre verificações de parada e
+ *   instante da última verificação
+ * stats/depth_nodes: contadores da thread e nós por profundidade
+ * reported_nodes/reported_depth: cópias de stats.nodes e stats.max_depth
+ *   publicadas a cada verificação, lidas pelos relatórios de progresso (-s,
+ *   --progress)
+ * solutions: soluções encontradas pela thread (-c/-e)
+ * out_buf/out_len: buffer de escrita das soluções (-e)
+ * best/best_depth: com -p, cópia do tabuleiro com mais peças colocadas que
+ *   a thread alcançou e o número dessas peças (lido pelo relatório -s)
+ * arena: bloco único, alinhado a ARENA_ALIGN, do qual saem todos os arrays
+ *   acima; os state_size primeiros bytes (de board a supply) são o estado
+ *   da busca, copiado de uma vez por copia_busca
+ * demand/supply: com -f, por cor, quantas bordas abertas (peça colocada
+ *   voltada para célula vazia) mostram a cor, e quantos lados das peças
+ *   ainda não usadas a têm
+ * hash: com -m, hash de Zobrist do estado (ver atualiza_hash)
+ * gpu_buf/gpu_len: com -g, lote de prefixos (as frontier primeiras peças na
+ *   ordem de visita) à espera do dispositivo
+ * tainted: com -m, os níveis abaixo deste não foram nem serão esgotados
+ *   por inteiro pela thread (tiveram solução, ou um ladrão levou parte de
+ *   um deles), e não podem entrar na tabela; ladrões o aumentam
+ */
+typedef struct {
+    int id;
+    unsigned short *board;
+    uint64_t *avail;
+    unsigned int *order;
+    frame *stack;
+    unsigned int depth;
+    unsigned int base;
+    uint64_t *masks;
+    uint64_t *scratch;
+    unsigned short *steal_buf;
+    unsigned int poll_nodes;
+    double last_poll;
+    counters stats;
+    unsigned long long *depth_nodes;
+    _Atomic unsigned long long reported_nodes;
+    _Atomic unsigned int reported_depth;
+    int *demand;
+    int *supply;
+    unsigned long long solutions;
+    char *out_buf;
+    size_t out_len;
+    unsigned short *best;
+    _Atomic unsigned int best_depth;
+    uint64_t hash;
+    _Atomic unsigned int tainted;
+    unsigned short *gpu_buf;
+    unsigned int gpu_len;
+    char *arena;
+    size_t state_size;
+} search;
+
+/* Índice da célula (x, y) no array do tabuleiro */
+#define CELL(g, x, y) (((y) + 1) * (g)->stride + (x) + 1)
+
+/* Bitset das referências com a cor color no lado side */
+#define SIDE_MASK(g, side, color) ((g)->side_mask + ((side) * ((g)->ncolors + 1) + (color)) * (g)->words)
+
+/*
+ * Chaves de Zobrist (-m): da peça id, da célula cell e da aresta edge com a
+ * cor color; a aresta entre uma célula e a vizinha de baixo ou da direita
+ * é 2 * célula + 1 ou 2 * célula
+ */
+#define Z_TILE(g, id) ((g)->zobrist[id])
+#define Z_CELL(g, cell) ((g)->zobrist[(g)->tile_count + (cell)])
+#define Z_EDGE(g, edge, color) ((g)->zobrist[(g)->tile_count + (g)->stride * (g)->stride + \
+                                             (edge) * ((g)->ncolors + 1) + (color)])
+
+/*
+ * Cabeçalho do arquivo de checkpoint, seguido de len unsigned short com os
+ * registros das unidades pendentes
+ * size/ncolors/tiles_hash identificam a instância; cell_order e canon_tile,
+ * as escolhas das quais dependem as células dos prefixos
+ * solutions: soluções já encontradas, a menos de rotação
+ */
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t solutions;
+    uint64_t len;
+    uint32_t size;
+    uint32_t ncolors;
+    uint32_t tiles_hash;
+    uint32_t cell_order;
+    int32_t canon_tile;
+} checkpoint_header;
+
+/*
+ * Estrutura para informações de peças de quina
+ * tile_id: ID da peça que pode ser quina
+ * rotation: rotação necessária para colocar na quina
+ * corner_type: tipo de quina (0=sup_esq, 1=sup_dir, 2=inf_esq, 3=inf_dir)
+ */
+typedef struct {
+    int tile_id;           
+    unsigned char rotation;
+    int corner_type;       
+} corner_info;
+
+/* Estimativa do tamanho de uma unidade, para ordená-las (gera_unidades) */
+typedef struct {
+    double size;           // Nós estimados da subárvore
+    int start;             // Posição do registro em work_units
+} unit_size;
+
+/* Último progresso de um processo recebido pelo processo 0 (--progress) */
+typedef struct {
+    unsigned long long nodes;      // Nós visitados
+    unsigned int depth;            // Profundidade máxima alcançada
+    double rate;                   // Nós/s desde o relato anterior
+    double time;                   // Instante do relato
+} progresso;
+
+/* Variáveis globais MPI e controle de execução */
+int rank, size;                    // Rank e tamanho de job_comm
+MPI_Comm job_comm = MPI_COMM_WORLD; // Processos que buscam (com -n, um por nó)
+int node_mode = 0;                 // Um processo por nó com as threads do nó (-n)
+atomic_int global_stop = 0;        // Flag para parada global
+atomic_int global_solution_found = 0; // Flag indicando se solução foi encontrada
+int solution_owner = -1;           // Rank do processo que encontrou a solução
+MPI_Comm work_comm = MPI_COMM_NULL; // Comunicador dos processos ativos
+int nactive = 0;                   // Número de processos ativos
+
+/*
+ * Protocolo de parada
+ * stop_rank: valor do MPI_Ibcast de parada (rank vencedor, ou -1 se a fila
+ *   acabou sem solução); os demais processos postam o Ibcast ao iniciar e o
+ *   processo 0 o completa quando decide parar
+ * stop_announced: o processo 0 já postou o Ibcast
+ * aviso_req: MPI_Issend do aviso de solução de um trabalhador ao processo 0
+ */
+int stop_rank = -1;
+MPI_Request stop_req = MPI_REQUEST_NULL;
+int stop_announced = 0;
+MPI_Request aviso_req = MPI_REQUEST_NULL;
+
+/* Threads de busca do processo */
+int nthreads = 1;                  // Número de threads por processo (-t)
+int forward_checking = 0;          // Poda por contagem de cores (-f)
+int cell_order = ORDEM_LINHA;      // Ordem de visita das células (-o)
+const char *order_names[] = { "linha", "moldura", "espiral", "mrv" };
+int count_mode = 0;                // Conta (-c) ou enumera (-e) todas as soluções
+int all_rotations = 0;             // Inclui as rotações de cada solução (-r)
+FILE *solutions_file = NULL;       // Arquivo deste processo com -e
+search *workers = NULL;            // Estado de busca de cada thread
+atomic_int idle_threads = 0;       // Threads sem trabalho na unidade atual
+atomic_int winner = -1;            // Thread que encontrou a solução, ou -1
+
+/*
+ * Modo determinístico (-d)
+ * As unidades são numeradas na ordem da busca serial, e vale a solução da
+ * menor unidade; dentro dela, a primeira na ordem dos candidatos entre as
+ * encontradas pelas threads. ordered_path guarda essa solução como as peças
+ * de cada nível, protegida por ordem_lock (só é tocada ao encontrar uma
+ * solução e nas verificações periódicas).
+ */
+int deterministic = 0;             // Reproduz a solução da busca serial (-d)
+unsigned short *ordered_path = NULL; // Primeira solução da unidade, por nível
+atomic_int ordered_thread = -1;    // Thread que a encontrou, ou -1
+atomic_flag ordem_lock = ATOMIC_FLAG_INIT;
+int ordered_unit = -1;             // Menor unidade com solução (processo 0)
+int ordered_owner = -1;            // Processo que a encontrou
+
+/*
+ * Fila de unidades de trabalho (mantida pelo processo 0)
+ * Os registros das unidades (ver UNIT_DEPTH) ficam um após o outro em
+ * work_units; os demais processos pedem unidades sob demanda.
+ */
+unsigned short *work_units = NULL; // Registros das unidades
+int *unit_start = NULL;            // Posição de cada registro em work_units
+int num_units = 0;                 // Total de unidades na fila
+int units_len = 0;                 // Tamanho ocupado de work_units
+int units_capacity = 0;            // Capacidade de work_units
+int starts_capacity = 0;           // Capacidade de unit_start
+int work_depth = 0;                // Maior prefixo das unidades
+int next_unit = 0;                 // Próxima unidade a ser entregue
+int idle_workers = 0;              // Trabalhadores que já receberam TAG_SEM_TRABALHO
+
+#define UNIT(i) (work_units + unit_start[i])
+
+/*
+ * Checkpoints (-k, --resume)
+ * A cada checkpoint_interval segundos, cada trabalhador envia seu estado ao
+ * processo 0, que grava no arquivo tudo o que falta buscar: as unidades
+ * ainda na fila, as de cada trabalhador (os níveis pendentes do último
+ * estado enviado ou, se ele ainda não enviou, a unidade inteira) e os
+ * níveis pendentes da própria pilha, com as soluções já contadas. Para
+ * capturar as pilhas, a thread 0 pausa as demais em seus pontos de
+ * verificação.
+ */
+const char *checkpoint_path = NULL;       // Arquivo de checkpoint (-k)
+double checkpoint_interval = CHECKPOINT_SECONDS; // Segundos entre checkpoints (-i)
+double last_checkpoint = 0;               // Instante do último checkpoint
+unsigned long long resumed_solutions = 0; // Soluções do checkpoint retomado
+unsigned short *task_buf = NULL;          // Níveis pendentes capturados das threads
+int *unit_of = NULL;                      // Unidade de cada processo, ou -1
+unsigned long long *worker_solutions = NULL; // Soluções informadas por cada trabalhador
+unsigned short **worker_tasks = NULL;     // Último estado de cada trabalhador
+int *worker_tasks_len = NULL;             // Seu tamanho (-1 se não enviou)
+atomic_int pausa = 0;                     // A thread 0 pediu uma pausa
+atomic_int paradas = 0;                   // Threads paradas na pausa
+atomic_int encerradas = 0;                // Threads que já deixaram a unidade
+int em_unidade = 0;                       // A thread 0 está executando uma unidade
+
+/*
+ * Modo lote (-b)
+ * O processo 0 lê todas as instâncias e as entrega sob demanda, uma por
+ * processo de cada vez, resolvendo também as suas; cada processo resolve a
+ * instância com suas threads e devolve o resultado, que o processo 0
+ * imprime assim que chega. O mundo MPI e as threads do OpenMP são os mesmos
+ * do começo ao fim do lote.
+ */
+int batch_mode = 0;
+game **batch_games = NULL;         // Instâncias ainda não entregues (processo 0)
+const char **batch_names = NULL;   // Origem de cada instância
+int batch_count = 0;               // Total de instâncias lidas
+int batch_next = 0;                // Próxima instância a ser entregue
+int batch_solved = 0;              // Instâncias com solução
+int batch_done_workers = 0;        // Processos que já receberam TAG_SEM_TRABALHO
+
+/* Melhor tabuleiro parcial (-p) e tempo limite (-l) */
+int partial_mode = 0;              // Guarda o tabuleiro mais fundo de cada thread
+double time_limit = 0;             // Segundos de busca permitidos (0 = sem limite)
+double time_start = 0;             // Início da contagem do tempo limite
+int time_expired = 0;              // O tempo limite interrompeu a busca
+int annealing = 0;                 // Recozimento simulado em vez do backtracking (-a)
+
+/*
+ * Tabela de becos sem saída (-m), compartilhada pelas threads do processo
+ * (com -n, do nó inteiro)
+ * Guarda o hash de estados cuja subárvore foi esgotada sem solução: o
+ * futuro da busca depende só das células preenchidas, das peças restantes e
+ * das cores voltadas para células vazias, que é o que o hash resume. Cada
+ * entrada é uma palavra atômica (0 = vazia); colisões entre hashes de 64
+ * bits são desprezadas.
+ */
+size_t cache_mb = 0;               // Memória da tabela em MiB (0 = desligada)
+_Atomic uint64_t *dead_cache = NULL; // Entradas, em baldes de CACHE_WAYS
+uint64_t cache_mask = 0;           // Número de entradas - 1 (potência de 2)
+
+/*
+ * Subárvores completadas no dispositivo (-g)
+ * gpu_cells: as últimas células de cada tabuleiro, completadas por
+ *   descarrega_fronteira com OpenMP target em vez de play()
+ * As tabelas abaixo são somente leitura e ficam no dispositivo durante toda
+ * a busca (ver prepara_gpu).
+ * gpu_cand/gpu_cand_start: candidatos por par de lados já preenchidos e
+ *   suas cores: gpu_cand[gpu_cand_start[k]..gpu_cand_start[k + 1]) para
+ *   k = GPU_KEY(par, cor do primeiro lado, cor do segundo), em ordem de
+ *   referência, só com as rotações distintas
+ * gpu_pair: para cada nível a partir de frontier, o par de lados (ver
+ *   gpu_sides) cujos vizinhos já estão preenchidos
+ * gpu_prev: a cópia anterior de cada peça (ver agrupa_copias), ou -1
+ * gpu_pieces/gpu_order: as peças e a ordem de visita do jogo, também no
+ *   dispositivo
+ */
+unsigned int gpu_cells = 0;        // Células completadas no dispositivo (0 = desligado)
+int gpu_devices = 0;               // Aceleradores visíveis ao processo
+unsigned short *gpu_cand = NULL;
+unsigned int *gpu_cand_start = NULL;
+unsigned int gpu_keys = 0;         // Tamanho de gpu_cand_start - 1
+unsigned int gpu_ncand = 0;        // Tamanho de gpu_cand
+unsigned char *gpu_pair = NULL;
+int *gpu_prev = NULL;
+piece *gpu_pieces = NULL;
+unsigned int *gpu_order = NULL;
+const unsigned char gpu_sides[6][2] = { {0, 1}, {0, 2}, {0, 3}, {1, 2}, {1, 3}, {2, 3} };
+
+#define GPU_KEY(g, pair, a, b) (((pair) * ((g)->ncolors + 1) + (a)) * ((g)->ncolors + 1) + (b))
+
+/* Relatório periódico de progresso (-s) */
+double stats_interval = 0;         // Segundos entre relatórios (0 = desligado)
+double stats_start = 0;            // Início da busca
+double last_report = 0;            // Instante do último relatório
+unsigned long long last_report_nodes = 0; // Nós do processo no último relatório
+
+/*
+ * Fluxo de progresso em JSON (--progress), para acompanhar a vazão de uma
+ * busca em andamento
+ * Cada trabalhador envia ao processo 0, a cada intervalo, seus nós e sua
+ * profundidade máxima, sem nunca esperar: um novo envio só parte depois
+ * que o anterior foi recebido. O processo 0 guarda o último relato de cada
+ * um e escreve uma linha por intervalo. Tudo acontece na thread 0, nos
+ * pontos de verificação; as threads de busca só publicam seus contadores.
+ */
+const char *progress_path = NULL;  // Arquivo de progresso (--progress)
+FILE *progress_file = NULL;        // Aberto pelo processo 0
+double progress_interval = PROGRESS_SECONDS; // Segundos entre linhas (--progress-interval)
+double last_progress = 0;          // Instante da última publicação
+double progress_start = 0;         // Início da busca distribuída
+unsigned long long progress_msg[2]; // Nós e profundidade do envio pendente
+MPI_Request progresso_req = MPI_REQUEST_NULL;
+progresso *progress_ranks = NULL;  // Último relato de cada processo (processo 0)
+
+/*
+ * Resolve as cores de cada peça em cada uma de suas 4 rotações
+ * (evita calcular (s + 4 - rotation) % 4 a cada comparação de borda)
+ */
+void build_pieces(game *g) {
+    g->pieces = malloc((4 * g->tile_count + 1) * sizeof(piece));
+    g->pieces[BORDER(g)] = PACK(0, 0, 0, 0);
+    for (unsigned int i = 0; i < g->tile_count; i++) {
+        unsigned char *c = g->tiles[i].colors;
+        for (int rot = 0; rot < 4; rot++) {
+            g->pieces[i * 4 + rot] = PACK(c[(4 - rot) % 4], c[(5 - rot) % 4],
+                                          c[(6 - rot) % 4], c[(7 - rot) % 4]);
+        }
+    }
+}
+
+/*
+ * Ordena chaves de 64 bits em ordem crescente
+ */
+int compara_chaves(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Agrupa as peças idênticas a menos de rotação e as rotações repetidas de
+ * uma mesma peça, que dariam subárvores idênticas
+ * distinct: referências cuja rotação é a primeira da peça com aquelas
+ *   cores (as demais nunca são candidatas)
+ * next_copy: a próxima peça do grupo de peças idênticas, em ordem de ID,
+ *   ou -1; só a primeira peça não usada de cada grupo fica disponível (ver
+ *   coloca_peca), e permutar peças idênticas não gera novos ramos
+ * Com -e, cada solução é escrita com suas próprias peças, e nada é agrupado.
+ * Os grupos saem da ordenação das peças pela menor de suas rotações.
+ */
+void agrupa_copias(game *g) {
+    int group = count_mode != 2;
+    uint64_t *keys = malloc(g->tile_count * sizeof(uint64_t));
+    g->distinct = calloc(g->words, sizeof(uint64_t));
+    g->next_copy = malloc(g->tile_count * sizeof(int));
+    for (unsigned int i = 0; i < g->tile_count; i++) {
+        piece key = g->pieces[i * 4];
+        for (int rot = 0; rot < 4; rot++) {
+            int repeated = 0;
+            for (int r = 0; r < rot; r++)
+                if (g->pieces[i * 4 + r] == g->pieces[i * 4 + rot]) repeated = 1;
+            if (!group || !repeated)
+                g->distinct[(i * 4 + rot) / WORD_BITS] |= 1ULL << ((i * 4 + rot) % WORD_BITS);
+            if (g->pieces[i * 4 + rot] < key) key = g->pieces[i * 4 + rot];
+        }
+        keys[i] = (uint64_t)key << 32 | i;
+        g->next_copy[i] = -1;
+    }
+    qsort(keys, g->tile_count, sizeof(uint64_t), compara_chaves);
+    for (unsigned int k = 1; k < g->tile_count && group; k++)
+        if (keys[k] >> 32 == keys[k - 1] >> 32)
+            g->next_copy[(uint32_t)keys[k - 1]] = (uint32_t)keys[k];
+    free(keys);
+}
+
+/*
+ * Constrói os bitsets de cores por lado
+ * Os candidatos de uma célula são a interseção das peças disponíveis com
+ * SIDE_MASK(lado, cor) de cada lado cujo vizinho já é conhecido (peça
+ * colocada ou anel, com cor 0), de modo que o próximo candidato válido sai
+ * de algumas operações por palavra em vez de percorrer peça por peça.
+ * Percorrer os bits em ordem crescente visita as peças na ordem
+ * (peça, rotação), a mesma da varredura exaustiva original.
+ */
+void build_masks(game *g) {
+    g->words = (4 * g->tile_count + WORD_BITS - 1) / WORD_BITS;
+    g->side_mask = calloc(4 * (g->ncolors + 1) * g->words, sizeof(uint64_t));
+    for (unsigned int ref = 0; ref < 4 * g->tile_count; ref++)
+        for (int side = 0; side < 4; side++)
+            SIDE_MASK(g, side, X_COLOR(g->pieces[ref], side))[ref / WORD_BITS] |=
+                1ULL << (ref % WORD_BITS);
+    agrupa_copias(g);
+}
+
+/*
+ * Retorna n soluções da busca com peças agrupadas (ver agrupa_copias)
+ * multiplicadas pelo número de soluções da busca completa que cada uma
+ * representa: por peça, 4 / (rotações distintas); por grupo de m peças
+ * idênticas, m! (ou (m - 1)! no da quina canônica, que não sai da quina).
+ * Satura em ULLONG_MAX.
+ */
+unsigned long long pondera_solucoes(game *g, unsigned long long n) {
+    unsigned char *copy = calloc(g->tile_count, 1);
+    for (unsigned int i = 0; i < g->tile_count; i++)
+        if (g->next_copy[i] >= 0) copy[g->next_copy[i]] = 1;
+    for (unsigned int i = 0; i < g->tile_count && n; i++) {
+        unsigned int rotations = __builtin_popcountll(g->distinct[TILE_WORD(i)] & TILE_BITS(i));
+        unsigned long long factor = 4 / rotations;
+        if (!copy[i]) {
+            unsigned long long m = 1;
+            for (int j = g->next_copy[i]; j >= 0; j = g->next_copy[j])
+                if (__builtin_mul_overflow(factor, (int)i == g->canon_tile ? m : m + 1, &factor))
+                    factor = ULLONG_MAX;
+                else
+                    m++;
+        }
+        if (__builtin_mul_overflow(n, factor, &n)) n = ULLONG_MAX;
+    }
+    free(copy);
+    return n;
+}
+
+/*
+ * Escreve em buf a contagem n de pondera_solucoes, marcando a saturação:
+ * ULLONG_MAX só diz que o total não cabe em 64 bits
+ * Retorna buf
+ */
+const char *formata_contagem(char buf[COUNT_TEXT], unsigned long long n) {
+    if (n == ULLONG_MAX)
+        snprintf(buf, COUNT_TEXT, "≥ %llu (estouro)", n);
+    else
+        snprintf(buf, COUNT_TEXT, "%llu", n);
+    return buf;
+}
+
+/*
+ * Restringe os candidatos da quina superior esquerda às rotações da peça
+ * tile (ou a todas as peças, se tile < 0), sem as repetidas
+ */
+void fixa_quina_canonica(game *g, int tile) {
+    g->canon_tile = tile;
+    g->root_mask = calloc(g->words, sizeof(uint64_t));
+    if (tile >= 0) {
+        g->root_mask[TILE_WORD(tile)] = TILE_BITS(tile);
+    } else {
+        for (unsigned int i = 0; i < g->tile_count; i++)
+            g->root_mask[TILE_WORD(i)] |= TILE_BITS(i);
+    }
+    for (unsigned int i = 0; i < g->words; i++)
+        g->root_mask[i] &= g->distinct[i];
+}
+
+/*
+ * Sorteia um número em [0, n) com o gerador xorshift64* de estado *state
+ */
+unsigned int sorteia(uint64_t *state, unsigned int n) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return (unsigned int)((*state * 2685821657736338717ULL) >> 32) % n;
+}
+
+/*
+ * Sorteia as chaves de Zobrist do jogo e aloca (ou, para um novo jogo do
+ * lote, esvazia) a tabela de becos sem saída com a maior potência de 2 de
+ * entradas que cabe em cache_mb MiB (-m)
+ */
+void prepara_tabela(game *g) {
+    size_t keys = g->tile_count + g->stride * g->stride +
+                  2 * g->stride * g->stride * (g->ncolors + 1);
+    uint64_t state = ESTIMATE_SEED;
+    g->zobrist = malloc(keys * sizeof(uint64_t));
+    for (size_t i = 0; i < keys; i++)
+        g->zobrist[i] = (uint64_t)sorteia(&state, 1u << 31) << 33 ^
+                        (uint64_t)sorteia(&state, 1u << 31) << 2 ^ sorteia(&state, 4);
+    
+    size_t entries = CACHE_WAYS;
+    while (entries * 2 * sizeof(uint64_t) <= cache_mb << 20) entries *= 2;
+    if (!dead_cache) {
+        dead_cache = aligned_alloc(ARENA_ALIGN, entries * sizeof(uint64_t));
+        cache_mask = entries - 1;
+    }
+    memset((void *)dead_cache, 0, entries * sizeof(uint64_t));
+}
+
+/*
+ * Retorna 1 se o estado de hash h está na tabela de becos sem saída
+ */
+int beco_conhecido(uint64_t h) {
+    h |= 1;
+    _Atomic uint64_t *b = dead_cache + (h & cache_mask & ~(uint64_t)(CACHE_WAYS - 1));
+    for (int i = 0; i < CACHE_WAYS; i++)
+        if (atomic_load_explicit(&b[i], memory_order_relaxed) == h) return 1;
+    return 0;
+}
+
+/*
+ * Guarda o estado de hash h na tabela de becos sem saída; com o balde
+ * cheio, substitui a entrada indicada pelos bits altos de h
+ */
+void guarda_beco(uint64_t h) {
+    h |= 1;
+    _Atomic uint64_t *b = dead_cache + (h & cache_mask & ~(uint64_t)(CACHE_WAYS - 1));
+    for (int i = 0; i < CACHE_WAYS; i++) {
+        uint64_t v = atomic_load_explicit(&b[i], memory_order_relaxed);
+        if (v == h) return;
+        if (v == 0) {
+            atomic_store_explicit(&b[i], h, memory_order_relaxed);
+            return;
+        }
+    }
+    atomic_store_explicit(&b[h >> 62], h, memory_order_relaxed);
+}
+
+/*
+ * Marca como não esgotados por inteiro os níveis abaixo de levels de s (-m)
+ */
+void marca_incompleto(search *s, unsigned int levels) {
+    unsigned int t = atomic_load(&s->tainted);
+    while (t < levels && !atomic_compare_exchange_weak(&s->tainted, &t, levels));
+}
+
+/*
+ * Copia o estado de busca de src (tabuleiro, peças disponíveis, pilha e
+ * bitsets) para dst, das mesmas dimensões, com um único memcpy da arena
+ * Nenhuma das duas pode estar buscando, nem ter níveis que um ladrão
+ * possa estar lendo.
+ */
+void copia_busca(search *dst, const search *src) {
+    memcpy(dst->arena, src->arena, src->state_size);
+    dst->hash = src->hash;
+    dst->depth = src->depth;
+    dst->base = src->base;
+}
+
+/*
+ * Reserva bytes na arena a partir da posição *used, arredondando para
+ * ARENA_ALIGN
+ * Retorna a posição reservada
+ */
+size_t reserva(size_t *used, size_t bytes) {
+    size_t at = *used;
+    *used += (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    return at;
+}
+
+/*
+ * Aloca o estado de busca de uma thread numa única arena: tabuleiro (com o
+ * anel de BORDER), disponibilidade, ordem, pilha, bitsets dos níveis e
+ * contagens de cores, seguidos dos buffers que não fazem parte do estado
+ * Se model não é NULL, o estado é copiado dele; senão, começa com todas
+ * as células vazias, todas as peças disponíveis e todos os níveis vazios.
+ * Nada mais é alocado durante a busca.
+ */
+void alloc_search(game *g, search *s, int id, const search *model) {
+    size_t used = 0;
+    size_t board = reserva(&used, g->stride * g->stride * sizeof(unsigned short));
+    size_t avail = reserva(&used, g->words * sizeof(uint64_t));
+    size_t order = reserva(&used, g->tile_count * sizeof(unsigned int));
+    size_t stack = reserva(&used, g->tile_count * sizeof(frame));
+    size_t masks = reserva(&used, g->tile_count * g->words * sizeof(uint64_t));
+    size_t demand = reserva(&used, (g->ncolors + 1) * sizeof(int));
+    size_t supply = reserva(&used, (g->ncolors + 1) * sizeof(int));
+    s->state_size = used;
+    size_t scratch = reserva(&used, g->words * sizeof(uint64_t));
+    size_t steal_buf = reserva(&used, g->tile_count * sizeof(unsigned short));
+    size_t depth_nodes = reserva(&used, (g->tile_count + 1) * sizeof(unsigned long long));
+    size_t out_buf = reserva(&used, count_mode == 2 ? SOLUTION_BUF : 0);
+    size_t best = reserva(&used, partial_mode ? g->stride * g->stride * sizeof(unsigned short) : 0);
+    
+    s->arena = aligned_alloc(ARENA_ALIGN, used);
+    memset(s->arena, 0, used);
+    s->board = (unsigned short *)(s->arena + board);
+    s->avail = (uint64_t *)(s->arena + avail);
+    s->order = (unsigned int *)(s->arena + order);
+    s->stack = (frame *)(s->arena + stack);
+    s->masks = (uint64_t *)(s->arena + masks);
+    s->demand = (int *)(s->arena + demand);
+    s->supply = (int *)(s->arena + supply);
+    s->scratch = (uint64_t *)(s->arena + scratch);
+    s->steal_buf = (unsigned short *)(s->arena + steal_buf);
+    s->depth_nodes = (unsigned long long *)(s->arena + depth_nodes);
+    s->out_buf = count_mode == 2 ? s->arena + out_buf : NULL;
+    s->best = partial_mode ? (unsigned short *)(s->arena + best) : NULL;
+    s->best_depth = 0;
+    
+    s->id = id;
+    memset(&s->stats, 0, sizeof(s->stats));
+    s->reported_nodes = 0;
+    s->reported_depth = 0;
+    s->poll_nodes = POLL_INTERVAL;
+    s->last_poll = get_time();
+    s->solutions = 0;
+    s->out_len = 0;
+    s->hash = 0;
+    s->tainted = 0;
+    s->gpu_buf = NULL;
+    s->gpu_len = 0;
+    if (model) {
+        copia_busca(s, model);
+        return;
+    }
+    
+    for (unsigned int i = 0; i < g->stride * g->stride; i++)
+        s->board[i] = BORDER(g);
+    for (unsigned int y = 0; y < g->size; y++)
+        for (unsigned int x = 0; x < g->size; x++)
+            s->board[CELL(g, x, y)] = EMPTY;
+    // De cada grupo de peças idênticas, só a primeira
+    for (unsigned int i = 0; i < g->tile_count; i++)
+        s->avail[TILE_WORD(i)] |= TILE_BITS(i);
+    for (unsigned int i = 0; i < g->tile_count; i++)
+        if (g->next_copy[i] >= 0)
+            s->avail[TILE_WORD(g->next_copy[i])] &= ~TILE_BITS(g->next_copy[i]);
+    memcpy(s->order, g->order, g->ncells * sizeof(unsigned int));
+    s->depth = s->base = 0;
+    
+    // Nenhuma borda aberta; todos os lados de todas as peças disponíveis
+    for (unsigned int i = 0; i < g->tile_count; i++)
+        for (int c = 0; c < 4; c++)
+            s->supply[g->tiles[i].colors[c]]++;
+}
+
+/*
+ * Libera o estado de busca de uma thread
+ */
+void free_search(search *s) {
+    free(s->gpu_buf);
+    free(s->arena);
+}
+
+/*
+ * Aloca o estado de busca das nthreads threads do processo; as demais
+ * threads copiam o estado inicial da thread 0
+ */
+void alloc_workers(game *g) {
+    if (cache_mb) prepara_tabela(g);
+    workers = malloc(nthreads * sizeof(search));
+    for (int t = 0; t < nthreads; t++)
+        alloc_search(g, &workers[t], t, t > 0 ? &workers[0] : NULL);
+}
+
+/*
+ * Entrada inteira em memória: lida com blocos de fread e percorrida uma
+ * única vez pelo parser, sem um fscanf por número
+ * pos: próximo byte a ler; line: linha de pos, para as mensagens de erro
+ */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t pos;
+    unsigned int line;
+} entrada;
+
+/*
+ * Formato binário das instâncias: BINARY_MAGIC, dimensão e número de cores
+ * em 32 bits little-endian e as 4 cores (um byte cada) de cada peça.
+ * Instâncias em texto e em binário podem vir concatenadas na mesma entrada.
+ */
+#define BINARY_MAGIC "ETB1"
+#define BINARY_HEADER 12
+
+/* Maior dimensão cujas referências (4 * size²) cabem em 16 bits, abaixo de EMPTY */
+#define MAX_SIZE 127
+
+/*
+ * Lê toda a entrada de input para a memória
+ */
+entrada *le_entrada(FILE *input) {
+    entrada *in = malloc(sizeof(entrada));
+    size_t capacity = 1 << 16, n;
+    in->data = malloc(capacity);
+    in->len = 0;
+    while ((n = fread(in->data + in->len, 1, capacity - in->len, input)) > 0) {
+        in->len += n;
+        if (in->len == capacity) {
+            capacity *= 2;
+            in->data = realloc(in->data, capacity);
+        }
+    }
+    in->pos = 0;
+    in->line = 1;
+    return in;
+}
+
+void libera_entrada(entrada *in) {
+    free(in->data);
+    free(in);
+}
+
+/*
+ * Pula espaços em branco, contando as linhas
+ * Retorna 1 se ainda há algo a ler
+ */
+int pula_espacos(entrada *in) {
+    while (in->pos < in->len &&
+           (in->data[in->pos] == ' ' || in->data[in->pos] == '\n' ||
+            in->data[in->pos] == '\t' || in->data[in->pos] == '\r')) {
+        if (in->data[in->pos] == '\n') in->line++;
+        in->pos++;
+    }
+    return in->pos < in->len;
+}
+
+/*
+ * Lê em value o próximo número sem sinal do texto; what descreve
+ * o número esperado na mensagem de erro
+ * Retorna 0 (com o erro já relatado em stderr) se não há número válido
+ */
+int le_numero(entrada *in, unsigned int *value, const char *what) {
+    if (!pula_espacos(in)) {
+        fprintf(stderr, "Entrada, linha %u: fim da entrada; esperava %s\n", in->line, what);
+        return 0;
+    }
+    unsigned long long v = 0;
+    size_t start = in->pos;
+    while (in->pos < in->len && in->data[in->pos] >= '0' && in->data[in->pos] <= '9' &&
+           v <= 0xffffffffULL)
+        v = v * 10 + (in->data[in->pos++] - '0');
+    if (in->pos == start) {
+        fprintf(stderr, "Entrada, linha %u: caractere '%c' inesperado; esperava %s\n",
+                in->line, in->data[in->pos], what);
+        return 0;
+    }
+    if (v > 0xffffffffULL) {
+        fprintf(stderr, "Entrada, linha %u: número grande demais em %s\n", in->line, what);
+        return 0;
+    }
+    *value = v;
+    return 1;
+}
+
+/*
+ * Lê um inteiro de 32 bits little-endian do formato binário
+ */
+unsigned int le_u32(const char *p) {
+    const unsigned char *b = (const unsigned char *)p;
+    return b[0] | b[1] << 8 | b[2] << 16 | (unsigned int)b[3] << 24;
+}
+
+/*
+ * Inicializa o jogo com a próxima instância da entrada, em texto (dimensão,
+ * número de cores e as 4 cores de cada peça) ou no formato binário
+ * Valida dimensões e cores, relatando em stderr a linha de cada erro
+ * Retorna ponteiro para estrutura game alocada dinamicamente, ou NULL se a
+ * entrada é inválida
+ */
+game *initialize(entrada *in) {
+    unsigned int bsize;
+    unsigned int ncolors;
+    int binary = in->len - in->pos >= BINARY_HEADER &&
+                 memcmp(in->data + in->pos, BINARY_MAGIC, 4) == 0;
+    
+    // Lê dimensões e valida entrada
+    if (binary) {
+        bsize = le_u32(in->data + in->pos + 4);
+        ncolors = le_u32(in->data + in->pos + 8);
+        in->pos += BINARY_HEADER;
+    } else if (!le_numero(in, &bsize, "a dimensão do tabuleiro") ||
+               !le_numero(in, &ncolors, "o número de cores")) {
+        return NULL;
+    }
+    if (bsize < 1 || bsize > MAX_SIZE) {
+        fprintf(stderr, "Entrada: dimensão %u fora do intervalo 1..%d\n", bsize, MAX_SIZE);
+        return NULL;
+    }
+    if (ncolors > 255) {
+        fprintf(stderr, "Entrada: %u cores; o máximo é 255\n", ncolors);
+        return NULL;
+    }
+    if (binary && in->len - in->pos < 4 * (size_t)bsize * bsize) {
+        fprintf(stderr, "Entrada: instância binária truncada\n");
+        return NULL;
+    }
+
+    // Aloca estrutura principal do jogo (sem bitsets nem ordem até a busca)
+    game *g = calloc(1, sizeof(game));
+    g->size = bsize;
+    g->tile_count = bsize * bsize;
+    
+    g->ncolors = ncolors;
+    g->stride = bsize + 2;
+
+    // Aloca e inicializa array de peças
+    g->tiles = malloc(g->tile_count * sizeof(tile));
+    for (unsigned int i = 0; i < g->tile_count; i++) {
+        // Lê cores das 4 bordas de cada peça
+        for (int c = 0; c < 4; c++) {
+            unsigned int color;
+            if (binary) {
+                color = (unsigned char)in->data[in->pos++];
+            } else if (!le_numero(in, &color, "a cor de uma peça")) {
+                free(g->tiles);
+                free(g);
+                return NULL;
+            }
+            if (color > ncolors) {
+                fprintf(stderr, "Entrada, %s %u: cor %u maior que o número de cores (%u)\n",
+                        binary ? "peça" : "linha", binary ? i : in->line, color, ncolors);
+                free(g->tiles);
+                free(g);
+                return NULL;
+            }
+            g->tiles[i].colors[c] = color;
+        }
+    }
+    
+    // Pré-calcula as peças rotacionadas
+    build_pieces(g);
+    return g;
+}
+
+/*
+ * Libera toda a memória alocada para o jogo
+ */
+void free_resources(game *game) {
+    free(game->side_mask);
+    free(game->root_mask);
+    free(game->distinct);
+    free(game->next_copy);
+    free(game->zobrist);
+    free(game->pieces);
+    free(game->order);
+    free(game->tiles);
+    free(game);
+}
+
+/*
+ * Atualiza as contagens de cores de s ao colocar (sign = 1) ou retirar
+ * (sign = -1) a peça ref da célula cell; na retirada, a peça ainda está
+ * no tabuleiro. Cada lado da peça deixa de estar disponível e abre uma
+ * borda se o vizinho está vazio, ou fecha a borda que o vizinho abria.
+ */
+void atualiza_bordas(game *g, search *s, unsigned int cell, unsigned short ref, int sign) {
+    piece p = g->pieces[ref];
+    for (int side = 0; side < 4; side++) {
+        unsigned int c = X_COLOR(p, side);
+        unsigned short nb = s->board[cell + g->offset[side]];
+        s->supply[c] -= sign;
+        if (nb == EMPTY)
+            s->demand[c] += sign;
+        else if (nb != BORDER(g))
+            s->demand[c] -= sign;
+    }
+}
+
+/*
+ * Verificação adiante após colocar a peça ref: nenhuma cor da peça pode
+ * ser exigida por mais bordas abertas do que há lados com essa cor nas
+ * peças restantes (as demais cores não mudaram de balanço)
+ * Retorna 1 se o tabuleiro parcial ainda pode ser completado por esse
+ * critério, 0 caso contrário
+ */
+int bordas_ok(game *g, search *s, unsigned short ref) {
+    piece p = g->pieces[ref];
+    for (int side = 0; side < 4; side++) {
+        unsigned int c = X_COLOR(p, side);
+        if (s->demand[c] > s->supply[c]) return 0;
+    }
+    return 1;
+}
+
+/*
+ * Atualiza o hash de s ao colocar ou retirar a peça ref da célula cell
+ * (-m): alterna as chaves da peça, da célula e, para cada vizinho fora do
+ * anel, da aresta com a cor do lado da peça. Com o vizinho vazio a aresta
+ * passa a ser (ou deixa de ser) aberta; com ele preenchido, deixa de ser
+ * (ou volta a ser) aberta com a mesma cor, pois as peças casam.
+ */
+void atualiza_hash(game *g, search *s, unsigned int cell, unsigned short ref) {
+    piece p = g->pieces[ref];
+    uint64_t h = Z_TILE(g, PIECE_ID(ref)) ^ Z_CELL(g, cell);
+    for (int side = 0; side < 4; side++) {
+        if (s->board[cell + g->offset[side]] == BORDER(g)) continue;
+        unsigned int edge = side == 0 ? 2 * (cell - g->stride) + 1 :
+                            side == 1 ? 2 * cell :
+                            side == 2 ? 2 * cell + 1 : 2 * (cell - 1);
+        h ^= Z_EDGE(g, edge, X_COLOR(p, side));
+    }
+    s->hash ^= h;
+}
+
+/*
+ * Coloca a peça ref na célula cell do estado s; a próxima cópia da peça,
+ * se houver, passa a estar disponível
+ */
+void coloca_peca(game *g, search *s, unsigned int cell, unsigned short ref) {
+    if (forward_checking) atualiza_bordas(g, s, cell, ref, 1);
+    if (dead_cache) atualiza_hash(g, s, cell, ref);
+    s->avail[TILE_WORD(PIECE_ID(ref))] &= ~TILE_BITS(PIECE_ID(ref));
+    int next = g->next_copy[PIECE_ID(ref)];
+    if (next >= 0) s->avail[TILE_WORD(next)] |= TILE_BITS(next);
+    s->board[cell] = ref;
+}
+
+/*
+ * Retira a peça da célula cell do estado s, que deve ser a última colocada
+ * entre as cópias da peça (as peças saem na ordem inversa da colocação)
+ */
+void retira_peca(game *g, search *s, unsigned int cell) {
+    unsigned short ref = s->board[cell];
+    if (forward_checking) atualiza_bordas(g, s, cell, ref, -1);
+    if (dead_cache) atualiza_hash(g, s, cell, ref);
+    int next = g->next_copy[PIECE_ID(ref)];
+    if (next >= 0) s->avail[TILE_WORD(next)] &= ~TILE_BITS(next);
+    s->avail[TILE_WORD(PIECE_ID(ref))] |= TILE_BITS(PIECE_ID(ref));
+    s->board[cell] = EMPTY;
+}
+
+/*
+ * Retorna o número de lados de cor 0 de todas as peças
+ */
+unsigned int lados_zero(game *g) {
+    unsigned int zeros = 0;
+    for (unsigned int i = 0; i < g->tile_count; i++)
+        for (int side = 0; side < 4; side++)
+            zeros += g->tiles[i].colors[side] == 0;
+    return zeros;
+}
+
+/*
+ * Verifica se as contagens de peças de quina, de borda e internas batem
+ * com o tamanho do tabuleiro: 4 quinas (dois lados 0 adjacentes),
+ * 4 * (size - 2) bordas (um lado 0) e as demais sem lado 0
+ * Só vale quando todo lado 0 fica no contorno (ver inviabilidade)
+ * Retorna 1 se são consistentes, 0 se o puzzle não pode ter solução
+ */
+int contagens_consistentes(game *g) {
+    if (g->size == 1) return g->pieces[0] == PACK(0, 0, 0, 0);
+    
+    unsigned int corners = 0, edges = 0, inner = 0;
+    for (unsigned int i = 0; i < g->tile_count; i++) {
+        unsigned char *c = g->tiles[i].colors;
+        int zeros = (c[0] == 0) + (c[1] == 0) + (c[2] == 0) + (c[3] == 0);
+        int adjacent = (c[0] == 0 && c[1] == 0) || (c[1] == 0 && c[2] == 0) ||
+                       (c[2] == 0 && c[3] == 0) || (c[3] == 0 && c[0] == 0);
+        if (zeros == 2 && adjacent) corners++;
+        else if (zeros == 1) edges++;
+        else if (zeros == 0) inner++;
+    }
+    return corners == 4 && edges == 4 * (g->size - 2) &&
+           inner == (g->size - 2) * (g->size - 2);
+}
+
+/*
+ * Verifica se as cores podem formar pares: cada aresta interna une dois
+ * lados da mesma cor, então cada cor não nula aparece um número par de
+ * vezes. Com split (todo lado 0 no contorno, e contagens_consistentes(g)),
+ * vale separadamente para os lados ao longo da borda (os vizinhos de um
+ * lado 0 nas peças de quina e de borda, que só encontram outros iguais) e
+ * para os demais lados
+ * Retorna 1 se as cores formam pares, 0 se o puzzle não pode ter solução
+ */
+int cores_pareadas(game *g, int split) {
+    unsigned int *along = calloc(2 * (g->ncolors + 1), sizeof(unsigned int));
+    unsigned int *across = along + g->ncolors + 1;
+    for (unsigned int i = 0; i < g->tile_count; i++) {
+        unsigned char *c = g->tiles[i].colors;
+        for (int side = 0; side < 4; side++) {
+            if (c[side] == 0) continue;
+            if (!split || c[(side + 1) % 4] == 0 || c[(side + 3) % 4] == 0)
+                along[c[side]]++;
+            else
+                across[c[side]]++;
+        }
+    }
+    int paired = 1;
+    for (unsigned int color = 1; color <= g->ncolors; color++)
+        if (along[color] % 2 || across[color] % 2) paired = 0;
+    free(along);
+    return paired;
+}
+
+/*
+ * Testes rápidos, O(peças), de condições necessárias para uma solução,
+ * feitos antes de montar qualquer estrutura da busca
+ * Retorna NULL se a instância passou em todos, ou o motivo do primeiro que
+ * falhou
+ */
+const char *inviabilidade(game *g) {
+    // O contorno tem 4 * size lados, todos de cor 0. Lados 0 além desses
+    // ficam no interior, em pares, e então as quinas e bordas não são
+    // reconhecíveis pelas cores
+    unsigned int zeros = lados_zero(g), outline = 4 * g->size;
+    if (zeros < outline || (zeros - outline) % 2)
+        return "lados de cor 0 não cobrem o contorno ou sobram sem par no interior";
+    int outline_only = zeros == outline;
+    if (outline_only && !contagens_consistentes(g))
+        return "contagens de peças de quina/borda inconsistentes com o tabuleiro";
+    if (!cores_pareadas(g, outline_only))
+        return "cores que aparecem um número ímpar de vezes não formam pares";
+    return NULL;
+}
+
+/*
+ * Verifica se uma peça pode ser colocada em alguma quina do tabuleiro
+ * Testa todas as 4 rotações para encontrar configuração válida
+ * Retorna 1 se é peça de quina, 0 caso contrário
+ * Parâmetros de saída: rotacao_valida e tipo_canto
+ */
+int eh_peca_de_quina(game *g, unsigned int id, unsigned char *rotacao_valida, int *tipo_canto) {
+    for (int rot = 0; rot < 4; rot++) {
+        piece p = g->pieces[id * 4 + rot];
+        
+        // Quina superior esquerda (Norte=0, Oeste=0)
+        if (N_COLOR(p) == 0 && W_COLOR(p) == 0) {
+            *rotacao_valida = rot;
+            *tipo_canto = 0;
+            return 1;
+        }
+        // Quina superior direita (Norte=0, Leste=0)
+        if (N_COLOR(p) == 0 && E_COLOR(p) == 0) {
+            *rotacao_valida = rot;
+            *tipo_canto = 1;
+            return 1;
+        }
+        // Quina inferior esquerda (Sul=0, Oeste=0)
+        if (S_COLOR(p) == 0 && W_COLOR(p) == 0) {
+            *rotacao_valida = rot;
+            *tipo_canto = 2;
+            return 1;
+        }
+        // Quina inferior direita (Sul=0, Leste=0)
+        if (S_COLOR(p) == 0 && E_COLOR(p) == 0) {
+            *rotacao_valida = rot;
+            *tipo_canto = 3;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Identifica todas as peças que podem ser colocadas nas quinas
+ * Retorna array dinâmico com informações das peças de quina
+ * Parâmetro de saída: num_corner_pieces (número de peças encontradas)
+ */
+corner_info* separar_pecas_de_quina(game *g, int *num_corner_pieces) {
+    corner_info *corners = malloc(g->tile_count * sizeof(corner_info));
+    *num_corner_pieces = 0;
+    
+    if (rank == 0 && !batch_mode) {
+        printf("=== Identificando peças de quina ===\n");
+    }
+    
+    // Testa cada peça para ver se pode ser quina
+    for (int i = 0; i < g->tile_count; i++) {
+        unsigned char rotacao_valida;
+        int tipo_canto;
+        
+        if (eh_peca_de_quina(g, i, &rotacao_valida, &tipo_canto)) {
+            corners[*num_corner_pieces].tile_id = i;
+            corners[*num_corner_pieces].rotation = rotacao_valida;
+            corners[*num_corner_pieces].corner_type = tipo_canto;
+            
+            if (rank == 0 && !batch_mode) {
+                printf("Peça ID %d pode ser quina tipo %d com rotação %u\n", 
+                       i, tipo_canto, rotacao_valida);
+            }
+            
+            (*num_corner_pieces)++;
+        }
+    }
+    
+    if (rank == 0 && !batch_mode) {
+        printf("Total de peças de quina: %d\n\n", *num_corner_pieces);
+    }
+    
+    // Redimensiona array para o tamanho exato
+    if (*num_corner_pieces > 0) {
+        corners = realloc(corners, (*num_corner_pieces) * sizeof(corner_info));
+    } else {
+        free(corners);
+        corners = NULL;
+    }
+    
+    return corners;
+}
+
+/*
+ * Escolhe a quina canônica entre as peças de quina
+ * Prefere uma peça sem cópia idêntica (mesmas cores em alguma rotação), para
+ * que a restrição continue válida quando peças idênticas forem tratadas como
+ * intercambiáveis; sem alguma assim, usa a de menor ID. Com -d não fixa
+ * nenhuma, pois a busca serial tenta todas as peças na quina
+ * Retorna o ID da peça, ou -1 se não há quinas (ou com -d)
+ */
+int escolhe_quina_canonica(game *g, corner_info *corners, int num_corners) {
+    if (deterministic) return -1;
+    for (int c = 0; c < num_corners; c++) {
+        unsigned int id = corners[c].tile_id;
+        int unique = 1;
+        for (unsigned int j = 0; j < g->tile_count && unique; j++) {
+            if (j == id) continue;
+            for (int rot = 0; rot < 4; rot++)
+                if (g->pieces[j * 4 + rot] == g->pieces[id * 4]) unique = 0;
+        }
+        if (unique) return id;
+    }
+    return num_corners > 0 ? corners[0].tile_id : -1;
+}
+
+/*
+ * Anuncia a todos os processos ativos o fim da busca (processo 0)
+ * owner é o rank que encontrou solução, ou -1 se a fila acabou sem solução;
+ * só o primeiro anúncio vale
+ */
+void anuncia_parada(int owner) {
+    if (stop_announced) return;
+    stop_announced = 1;
+    stop_rank = solution_owner = owner;
+    global_stop = 1;
+    if (owner >= 0) global_solution_found = 1;
+    MPI_Ibcast(&stop_rank, 1, MPI_INT, 0, work_comm, &stop_req);
+}
+
+/*
+ * Responde ao pedido de trabalho do processo src com a próxima unidade da
+ * fila, ou com TAG_SEM_TRABALHO se a fila acabou ou a busca já parou; todo
+ * pedido recebe resposta, de modo que o trabalhador pode esperá-la com um
+ * MPI_Recv bloqueante
+ */
+void atende_pedido(int src) {
+    MPI_Recv(&worker_solutions[src], 1, MPI_UNSIGNED_LONG_LONG, src, TAG_PEDIDO,
+             work_comm, MPI_STATUS_IGNORE);
+    
+    // A unidade anterior acabou: o trabalhador fica só com a nova
+    worker_tasks_len[src] = -1;
+    if (next_unit < num_units && !global_stop && ordered_unit < 0) {
+        unsigned short *u = UNIT(next_unit);
+        MPI_Send(u, UNIT_LEN(u), MPI_UNSIGNED_SHORT, src, TAG_TRABALHO, work_comm);
+        unit_of[src] = next_unit++;
+    } else {
+        MPI_Send(NULL, 0, MPI_UNSIGNED_SHORT, src, TAG_SEM_TRABALHO, work_comm);
+        unit_of[src] = -1;
+        idle_workers++;
+    }
+}
+
+/*
+ * Recebe o estado do processo src para o checkpoint (processo 0)
+ */
+void recebe_estado(int src) {
+    MPI_Status status;
+    int bytes, pos = 0, len;
+    MPI_Probe(src, TAG_ESTADO, work_comm, &status);
+    MPI_Get_count(&status, MPI_PACKED, &bytes);
+    char *buf = malloc(bytes);
+    MPI_Recv(buf, bytes, MPI_PACKED, src, TAG_ESTADO, work_comm, MPI_STATUS_IGNORE);
+    
+    MPI_Unpack(buf, bytes, &pos, &worker_solutions[src], 1, MPI_UNSIGNED_LONG_LONG, work_comm);
+    MPI_Unpack(buf, bytes, &pos, &len, 1, MPI_INT, work_comm);
+    worker_tasks[src] = realloc(worker_tasks[src], (len + 1) * sizeof(unsigned short));
+    MPI_Unpack(buf, bytes, &pos, worker_tasks[src], len, MPI_UNSIGNED_SHORT, work_comm);
+    worker_tasks_len[src] = len;
+    free(buf);
+}
+
+/*
+ * Registra que o processo owner encontrou solução na unidade u (processo 0,
+ * -d); vale a de menor unidade
+ */
+void registra_ordem(int owner, int u) {
+    if (ordered_unit < 0 || u < ordered_unit) {
+        ordered_unit = u;
+        ordered_owner = owner;
+    }
+}
+
+/*
+ * Anuncia a parada quando nenhum processo executa mais uma unidade anterior
+ * à menor com solução (processo 0, -d); as posteriores, ainda em execução,
+ * são canceladas pelo próprio anúncio
+ */
+void confere_ordem() {
+    if (stop_announced || ordered_unit < 0) return;
+    for (int w = 0; w < nactive; w++)
+        if (unit_of[w] >= 0 && unit_of[w] < ordered_unit) return;
+    anuncia_parada(ordered_owner);
+}
+
+/*
+ * Recebe o aviso de solução do processo src e anuncia a parada (processo 0)
+ * Com -d, o aviso é da unidade que src executa, e a parada espera as
+ * anteriores (confere_ordem)
+ */
+void recebe_aviso(int src) {
+    int owner;
+    MPI_Recv(&owner, 1, MPI_INT, src, TAG_PARADA, work_comm, MPI_STATUS_IGNORE);
+    if (deterministic)
+        registra_ordem(owner, unit_of[src]);
+    else
+        anuncia_parada(owner);
+}
+
+/*
+ * Guarda o relato de progresso do processo src recebido em now
+ */
+void anota_progresso(int src, const unsigned long long *msg, double now) {
+    progresso *p = &progress_ranks[src];
+    if (now > p->time) p->rate = (msg[0] - p->nodes) / (now - p->time);
+    p->nodes = msg[0];
+    p->depth = msg[1];
+    p->time = now;
+}
+
+/*
+ * Recebe o relato de progresso de um trabalhador (processo 0)
+ */
+void recebe_progresso(int src) {
+    unsigned long long msg[2];
+    MPI_Recv(msg, 2, MPI_UNSIGNED_LONG_LONG, src, TAG_PROGRESSO, work_comm, MPI_STATUS_IGNORE);
+    anota_progresso(src, msg, get_time());
+}
+
+/*
+ * Escreve uma linha JSON com o progresso de todos os processos ativos
+ * (processo 0): tempo, nós, nós/s, profundidade máxima, unidades ainda na
+ * fila e em execução e, por processo, os mesmos contadores do último relato
+ * final: a busca terminou (última linha do arquivo)
+ */
+void escreve_progresso(game *g, double now, int final) {
+    unsigned long long nodes = 0;
+    unsigned int depth = 0;
+    double rate = 0;
+    int running = 0;
+    for (int r = 0; r < nactive; r++) {
+        nodes += progress_ranks[r].nodes;
+        rate += progress_ranks[r].rate;
+        if (progress_ranks[r].depth > depth) depth = progress_ranks[r].depth;
+        if (unit_of[r] >= 0) running++;
+    }
+    fprintf(progress_file, "{\"time\":%.3f,\"nodes\":%llu,\"nodes_per_sec\":%.0f,"
+            "\"best_depth\":%u,\"cells\":%u,\"units_queued\":%d,\"units_running\":%d,"
+            "\"final\":%s,\"ranks\":[", now - progress_start, nodes, rate, depth,
+            g->ncells, num_units - next_unit,
+            running, final ? "true" : "false");
+    for (int r = 0; r < nactive; r++)
+        fprintf(progress_file, "%s{\"rank\":%d,\"nodes\":%llu,\"nodes_per_sec\":%.0f,"
+                "\"best_depth\":%u}", r ? "," : "", r, progress_ranks[r].nodes,
+                progress_ranks[r].rate, progress_ranks[r].depth);
+    fprintf(progress_file, "]}\n");
+    fflush(progress_file);
+}
+
+/*
+ * Publica o progresso deste processo (--progress): o processo 0 anota o
+ * próprio e escreve a linha; os demais enviam o seu ao processo 0 se o
+ * envio anterior já foi recebido (senão, pulam este intervalo)
+ * final: a busca do processo terminou, e os contadores das threads podem
+ * ser lidos diretamente, já completos
+ */
+void publica_progresso(game *g, double now, int final) {
+    unsigned long long msg[2] = { 0, 0 };
+    for (int t = 0; t < nthreads; t++) {
+        unsigned long long d;
+        if (final) {
+            msg[0] += workers[t].stats.nodes;
+            d = workers[t].stats.max_depth;
+        } else {
+            msg[0] += atomic_load_explicit(&workers[t].reported_nodes, memory_order_relaxed);
+            d = atomic_load_explicit(&workers[t].reported_depth, memory_order_relaxed);
+        }
+        if (d > msg[1]) msg[1] = d;
+    }
+    if (rank == 0) {
+        anota_progresso(0, msg, now);
+        escreve_progresso(g, now, final);
+    } else {
+        int flag;
+        MPI_Test(&progresso_req, &flag, MPI_STATUS_IGNORE);
+        if (flag) {
+            memcpy(progress_msg, msg, sizeof(msg));
+            MPI_Issend(progress_msg, 2, MPI_UNSIGNED_LONG_LONG, 0, TAG_PROGRESSO, work_comm,
+                       &progresso_req);
+        }
+    }
+    last_progress = now;
+}
+
+/*
+ * Trata a mensagem sondada em status (processo 0)
+ * Mensagens de um mesmo trabalhador são tratadas na ordem de envio, de modo
+ * que um estado nunca é confundido com o da unidade seguinte
+ */
+void atende_mensagem(MPI_Status *status) {
+    if (status->MPI_TAG == TAG_PEDIDO)
+        atende_pedido(status->MPI_SOURCE);
+    else if (status->MPI_TAG == TAG_PARADA)
+        recebe_aviso(status->MPI_SOURCE);
+    else if (status->MPI_TAG == TAG_ESTADO)
+        recebe_estado(status->MPI_SOURCE);
+    else if (status->MPI_TAG == TAG_PROGRESSO)
+        recebe_progresso(status->MPI_SOURCE);
+}
+
+/*
+ * Esvazia o buffer de soluções de s no arquivo do processo
+ * Um único fwrite por buffer: o stdio serializa as escritas das threads,
+ * e nenhuma solução fica dividida entre threads
+ */
+void descarrega_solucoes(search *s) {
+    if (s->out_len) fwrite(s->out_buf, 1, s->out_len, solutions_file);
+    s->out_len = 0;
+}
+
+/*
+ * Esvazia os buffers de soluções de todas as threads do processo (com as
+ * demais threads pausadas ou fora da busca)
+ */
+void descarrega_processo() {
+    if (!solutions_file) return;
+    for (int t = 0; t < nthreads; t++)
+        descarrega_solucoes(&workers[t]);
+    fflush(solutions_file);
+}
+
+/*
+ * Retorna as soluções encontradas pelas threads do processo
+ */
+unsigned long long soma_solucoes() {
+    unsigned long long total = 0;
+    for (int t = 0; t < nthreads; t++)
+        total += workers[t].solutions;
+    return total;
+}
+
+/*
+ * Pausa as demais threads do processo para capturar suas pilhas (thread 0)
+ * Cada uma para no próximo ponto de verificação; as que já deixaram a
+ * unidade contam como paradas. Fora de uma unidade não há o que pausar.
+ */
+void pausa_threads() {
+    if (!em_unidade) return;
+    atomic_store(&pausa, 1);
+    while (atomic_load(&paradas) + atomic_load(&encerradas) < nthreads - 1)
+        sched_yield();
+}
+
+/*
+ * Libera as threads pausadas e espera que todas retomem, para que a pausa
+ * seguinte não as encontre ainda contadas como paradas
+ */
+void retoma_threads() {
+    if (!em_unidade) return;
+    atomic_store(&pausa, 0);
+    while (atomic_load(&paradas) > 0)
+        sched_yield();
+}
+
+/*
+ * Ponto de parada das threads (exceto a 0) enquanto a pausa durar
+ */
+void aguarda_pausa() {
+    atomic_fetch_add(&paradas, 1);
+    while (atomic_load(&pausa))
+        sched_yield();
+    atomic_fetch_sub(&paradas, 1);
+}
+
+/*
+ * Grava em task_buf, como registros de unidade, os níveis pendentes das
+ * pilhas das threads do processo (já pausadas): cada nível d entre base e
+ * depth com candidatos restantes vira o prefixo das d primeiras células e
+ * o intervalo que ainda falta
+ * Retorna o tamanho ocupado em task_buf
+ */
+int captura_tarefas(game *g) {
+    int len = 0;
+    if (!em_unidade) return 0;
+    for (int t = 0; t < nthreads; t++) {
+        search *s = &workers[t];
+        for (unsigned int d = s->base; d <= s->depth && d < g->ncells; d++) {
+            unsigned long long w = atomic_load_explicit(&s->stack[d].range, memory_order_acquire);
+            if (R_NEXT(w) >= R_END(w)) continue;
+            unsigned short *u = task_buf + len;
+            UNIT_DEPTH(u) = d;
+            UNIT_NEXT(u) = R_NEXT(w);
+            UNIT_END(u) = R_END(w);
+            for (unsigned int i = 0; i < d; i++)
+                UNIT_PREFIX(u)[i] = s->board[s->order[i]];
+            len += UNIT_LEN(u);
+        }
+    }
+    return len;
+}
+
+/*
+ * Envia ao processo 0 o estado deste processo para o checkpoint: as
+ * soluções encontradas e os níveis pendentes das pilhas, capturados juntos
+ * durante uma pausa para que um reflita exatamente o outro
+ */
+void envia_estado(game *g) {
+    pausa_threads();
+    int len = captura_tarefas(g);
+    unsigned long long found = soma_solucoes();
+    descarrega_processo();
+    retoma_threads();
+    
+    int header_size, tasks_size, pos = 0;
+    MPI_Pack_size(1, MPI_UNSIGNED_LONG_LONG, work_comm, &header_size);
+    MPI_Pack_size(1, MPI_INT, work_comm, &tasks_size);
+    header_size += tasks_size;
+    MPI_Pack_size(len, MPI_UNSIGNED_SHORT, work_comm, &tasks_size);
+    int buf_size = header_size + tasks_size;
+    char *buf = malloc(buf_size);
+    MPI_Pack(&found, 1, MPI_UNSIGNED_LONG_LONG, buf, buf_size, &pos, work_comm);
+    MPI_Pack(&len, 1, MPI_INT, buf, buf_size, &pos, work_comm);
+    MPI_Pack(task_buf, len, MPI_UNSIGNED_SHORT, buf, buf_size, &pos, work_comm);
+    MPI_Send(buf, pos, MPI_PACKED, 0, TAG_ESTADO, work_comm);
+    free(buf);
+}
+
+/*
+ * Hash FNV-1a das cores das peças, para reconhecer a instância de um
+ * checkpoint
+ */
+uint32_t hash_pecas(game *g) {
+    uint32_t h = 2166136261u;
+    for (unsigned int i = 0; i < g->tile_count; i++)
+        for (int c = 0; c < 4; c++)
+            h = (h ^ g->tiles[i].colors[c]) * 16777619u;
+    return h;
+}
+
+/*
+ * Grava o checkpoint (processo 0)
+ * O arquivo é escrito ao lado e renomeado, de modo que uma interrupção no
+ * meio da gravação preserva o checkpoint anterior
+ */
+void grava_checkpoint(game *g) {
+    pausa_threads();
+    int len = captura_tarefas(g);
+    unsigned long long found = soma_solucoes();
+    descarrega_processo();
+    retoma_threads();
+    
+    checkpoint_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CHECKPOINT_MAGIC, 4);
+    h.version = CHECKPOINT_VERSION;
+    h.size = g->size;
+    h.ncolors = g->ncolors;
+    h.tiles_hash = hash_pecas(g);
+    h.cell_order = cell_order;
+    h.canon_tile = g->canon_tile;
+    h.len = len;
+    for (int w = 1; w < nactive; w++) {
+        found += worker_solutions[w];
+        if (worker_tasks_len[w] >= 0)
+            h.len += worker_tasks_len[w];
+        else if (unit_of[w] >= 0)
+            h.len += UNIT_LEN(UNIT(unit_of[w]));
+    }
+    for (int u = next_unit; u < num_units; u++)
+        h.len += UNIT_LEN(UNIT(u));
+    h.solutions = resumed_solutions + found / (all_rotations ? 4 : 1);
+    
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.tmp", checkpoint_path);
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "Processo 0: não foi possível criar %s\n", path);
+        return;
+    }
+    fwrite(&h, sizeof(h), 1, f);
+    fwrite(task_buf, sizeof(unsigned short), len, f);
+    for (int w = 1; w < nactive; w++) {
+        if (worker_tasks_len[w] >= 0)
+            fwrite(worker_tasks[w], sizeof(unsigned short), worker_tasks_len[w], f);
+        else if (unit_of[w] >= 0)
+            fwrite(UNIT(unit_of[w]), sizeof(unsigned short), UNIT_LEN(UNIT(unit_of[w])), f);
+    }
+    for (int u = next_unit; u < num_units; u++)
+        fwrite(UNIT(u), sizeof(unsigned short), UNIT_LEN(UNIT(u)), f);
+    if (fclose(f) == 0)
+        rename(path, checkpoint_path);
+}
+
+/*
+ * Imprime o tabuleiro parcial refs (linha por linha, "- -" nas células
+ * vazias) com o número de peças e de arestas internas casadas; como toda
+ * peça colocada casa com os vizinhos já colocados, as arestas casadas são
+ * as entre duas células ocupadas
+ */
+void imprime_parcial(unsigned int size, const unsigned short *refs, int owner) {
+    unsigned int pieces = 0, edges = 0;
+    for (unsigned int y = 0; y < size; y++)
+        for (unsigned int x = 0; x < size; x++) {
+            if (refs[y * size + x] == EMPTY) continue;
+            pieces++;
+            if (x + 1 < size && refs[y * size + x + 1] != EMPTY) edges++;
+            if (y + 1 < size && refs[(y + 1) * size + x] != EMPTY) edges++;
+        }
+    printf("\n=== MELHOR SOLUÇÃO PARCIAL (processo %d) ===\n", owner);
+    printf("%u de %u peças, %u de %u arestas internas casadas\n", pieces, size * size,
+           edges, 2 * size * (size - 1));
+    for (unsigned int i = 0; i < size * size; i++) {
+        if (refs[i] == EMPTY)
+            printf("- -\n");
+        else
+            printf("%u %u\n", PIECE_ID(refs[i]), PIECE_ROT(refs[i]));
+    }
+}
+
+/*
+ * Imprime o resultado da instância index do lote, resolvida pelo processo
+ * owner (processo 0)
+ * refs: as board_size² peças, linha por linha, da solução (found) ou, com
+ *   -p, do melhor tabuleiro parcial; NULL se não há nenhum
+ * expired: o tempo limite interrompeu a busca
+ * motivo: por que inviabilidade descartou a instância sem buscar, ou NULL
+ */
+void imprime_resultado(int index, int owner, int found, int expired, const char *motivo,
+                       double seconds, unsigned long long nodes, unsigned long long solutions,
+                       unsigned short *refs, unsigned int board_size) {
+    printf("\n=== Instância %d (%s): processo %d, %.6f segundos, %llu nós ===\n",
+           index + 1, batch_names[index], owner, seconds, nodes);
+    if (expired) printf("Tempo limite esgotado: busca interrompida\n");
+    if (motivo) printf("Instância sem solução: %s\n", motivo);
+    if (count_mode) {
+        char text[COUNT_TEXT];
+        printf("Total de soluções%s: %s\n", all_rotations ? "" : " (a menos de rotação)",
+               formata_contagem(text, solutions));
+    } else if (found) {
+        for (unsigned int i = 0; i < board_size * board_size; i++)
+            printf("%u %u\n", PIECE_ID(refs[i]), PIECE_ROT(refs[i]));
+    } else {
+        if (refs) imprime_parcial(board_size, refs, owner);
+        printf("SOLUÇÃO NÃO ENCONTRADA\n");
+    }
+    if (found) batch_solved++;
+    fflush(stdout);
+}
+
+/*
+ * Envia ao processo dest a próxima instância do lote (que deixa de ser
+ * mantida aqui), ou TAG_SEM_TRABALHO se o lote acabou (processo 0)
+ */
+void envia_instancia(int dest) {
+    if (batch_next == batch_count) {
+        MPI_Send(NULL, 0, MPI_BYTE, dest, TAG_SEM_TRABALHO, job_comm);
+        batch_done_workers++;
+        return;
+    }
+    int index = batch_next++;
+    game *g = batch_games[index];
+    int header[3] = { index, g->size, g->ncolors };
+    int header_size, tiles_size, pos = 0;
+    MPI_Pack_size(3, MPI_INT, job_comm, &header_size);
+    MPI_Pack_size(g->tile_count * sizeof(tile), MPI_BYTE, job_comm, &tiles_size);
+    int buf_size = header_size + tiles_size;
+    char *buf = malloc(buf_size);
+    MPI_Pack(header, 3, MPI_INT, buf, buf_size, &pos, job_comm);
+    MPI_Pack(g->tiles, g->tile_count * sizeof(tile), MPI_BYTE, buf, buf_size, &pos, job_comm);
+    MPI_Send(buf, pos, MPI_PACKED, dest, TAG_INSTANCIA, job_comm);
+    free(buf);
+    free_resources(g);
+    batch_games[index] = NULL;
+}
+
+/*
+ * Envia ao processo 0 o resultado da instância index (-1 no primeiro
+ * pedido): achou solução, tempo esgotado, motivo de inviabilidade (ou
+ * NULL), nós e soluções, tempo e as board_size² peças da solução ou do
+ * melhor parcial (board_size 0 se não há)
+ */
+void envia_resultado(int index, int found, int expired, const char *motivo,
+                     unsigned long long nodes, unsigned long long solutions, double seconds,
+                     unsigned short *refs, int board_size) {
+    int count = board_size * board_size;
+    int length = motivo ? strlen(motivo) : 0;
+    int header[5] = { index, found, expired, board_size, length };
+    unsigned long long counts[2] = { nodes, solutions };
+    int sizes[5], pos = 0;
+    MPI_Pack_size(5, MPI_INT, job_comm, &sizes[0]);
+    MPI_Pack_size(2, MPI_UNSIGNED_LONG_LONG, job_comm, &sizes[1]);
+    MPI_Pack_size(1, MPI_DOUBLE, job_comm, &sizes[2]);
+    MPI_Pack_size(count, MPI_UNSIGNED_SHORT, job_comm, &sizes[3]);
+    MPI_Pack_size(length, MPI_CHAR, job_comm, &sizes[4]);
+    int buf_size = sizes[0] + sizes[1] + sizes[2] + sizes[3] + sizes[4];
+    char *buf = malloc(buf_size);
+    MPI_Pack(header, 5, MPI_INT, buf, buf_size, &pos, job_comm);
+    MPI_Pack(counts, 2, MPI_UNSIGNED_LONG_LONG, buf, buf_size, &pos, job_comm);
+    MPI_Pack(&seconds, 1, MPI_DOUBLE, buf, buf_size, &pos, job_comm);
+    MPI_Pack(refs, count, MPI_UNSIGNED_SHORT, buf, buf_size, &pos, job_comm);
+    MPI_Pack(motivo, length, MPI_CHAR, buf, buf_size, &pos, job_comm);
+    MPI_Send(buf, pos, MPI_PACKED, 0, TAG_LOTE, job_comm);
+    free(buf);
+}
+
+/*
+ * Recebe o resultado do processo src, imprime e lhe entrega a próxima
+ * instância (processo 0)
+ */
+void atende_resultado(int src) {
+    MPI_Status status;
+    int bytes, pos = 0;
+    MPI_Probe(src, TAG_LOTE, job_comm, &status);
+    MPI_Get_count(&status, MPI_PACKED, &bytes);
+    char *buf = malloc(bytes);
+    MPI_Recv(buf, bytes, MPI_PACKED, src, TAG_LOTE, job_comm, MPI_STATUS_IGNORE);
+    
+    int header[5];
+    unsigned long long counts[2];
+    double seconds;
+    MPI_Unpack(buf, bytes, &pos, header, 5, MPI_INT, job_comm);
+    MPI_Unpack(buf, bytes, &pos, counts, 2, MPI_UNSIGNED_LONG_LONG, job_comm);
+    MPI_Unpack(buf, bytes, &pos, &seconds, 1, MPI_DOUBLE, job_comm);
+    int count = header[3] * header[3];
+    unsigned short *refs = malloc((count + 1) * sizeof(unsigned short));
+    MPI_Unpack(buf, bytes, &pos, refs, count, MPI_UNSIGNED_SHORT, job_comm);
+    char *motivo = malloc(header[4] + 1);
+    MPI_Unpack(buf, bytes, &pos, motivo, header[4], MPI_CHAR, job_comm);
+    motivo[header[4]] = '\0';
+    if (header[0] >= 0)
+        imprime_resultado(header[0], src, header[1], header[2], header[4] ? motivo : NULL,
+                          seconds, counts[0], counts[1], count ? refs : NULL, header[3]);
+    free(motivo);
+    free(refs);
+    free(buf);
+    envia_instancia(src);
+}
+
+/*
+ * Atende os resultados pendentes dos demais processos (processo 0)
+ */
+void atende_lote() {
+    int flag;
+    MPI_Status status;
+    MPI_Iprobe(MPI_ANY_SOURCE, TAG_LOTE, job_comm, &flag, &status);
+    while (flag) {
+        atende_resultado(status.MPI_SOURCE);
+        MPI_Iprobe(MPI_ANY_SOURCE, TAG_LOTE, job_comm, &flag, &status);
+    }
+}
+
+/*
+ * Relata em stderr os nós visitados pelo processo até agora e a taxa desde
+ * o último relatório (thread 0, -s)
+ * Lê apenas os contadores publicados pelas threads em seus pontos de
+ * verificação, sem pausá-las
+ */
+void relata_progresso() {
+    unsigned long long nodes = 0;
+    for (int t = 0; t < nthreads; t++)
+        nodes += atomic_load_explicit(&workers[t].reported_nodes, memory_order_relaxed);
+    double now = get_time();
+    fprintf(stderr, "Processo %d: %llu nós em %.1f s (%.0f nós/s)", rank, nodes,
+            now - stats_start, (nodes - last_report_nodes) / (now - last_report));
+    if (partial_mode) {
+        unsigned int best = 0;
+        for (int t = 0; t < nthreads; t++) {
+            unsigned int d = atomic_load_explicit(&workers[t].best_depth, memory_order_relaxed);
+            if (d > best) best = d;
+        }
+        fprintf(stderr, ", melhor parcial com %u peças", best);
+    }
+    fprintf(stderr, "\n");
+    last_report = now;
+    last_report_nodes = nodes;
+}
+
+/*
+ * Retorna 1 se o tempo limite (-l) já se esgotou
+ */
+int tempo_esgotado() {
+    return time_limit > 0 && get_time() - time_start >= time_limit;
+}
+
+/*
+ * Interrompe a busca porque o tempo limite se esgotou (processo 0); com -k,
+ * grava antes um checkpoint final (com os últimos estados recebidos dos
+ * trabalhadores), do qual a busca pode ser retomada. Com -d, uma solução
+ * já encontrada é mantida, mesmo sem a garantia de ser a da busca serial
+ */
+void encerra_por_tempo(game *g) {
+    time_expired = 1;
+    if (checkpoint_path) grava_checkpoint(g);
+    anuncia_parada(ordered_owner);
+}
+
+/*
+ * Verifica se a busca local deve parar
+ * No processo 0, atende os pedidos de trabalho, os avisos de solução e os
+ * estados pendentes, de modo que ele distribui a fila sem deixar de buscar;
+ * nos demais, apenas testa se o Ibcast de parada já chegou. Com -k, é
+ * também onde cada processo grava ou envia seu checkpoint.
+ * Retorna 1 se a busca local deve parar
+ */
+int verifica_parada(game *g) {
+    if (global_stop || global_solution_found) return 1;
+    double now = get_time();
+    int expired = tempo_esgotado();
+    if (batch_mode) {
+        // No lote, cada instância é resolvida por um único processo, e o
+        // tempo limite vale para cada uma
+        if (rank == 0) atende_lote();
+        if (expired) time_expired = global_stop = 1;
+        return expired;
+    }
+    if (work_comm == MPI_COMM_NULL) return 0; // Ainda gerando as unidades
+    
+    int flag;
+    MPI_Status status;
+    int checkpoint_due = checkpoint_path && now - last_checkpoint >= checkpoint_interval;
+    if (stats_interval > 0 && now - last_report >= stats_interval) relata_progresso();
+    if (progress_path && now - last_progress >= progress_interval) publica_progresso(g, now, 0);
+    
+    if (rank == 0) {
+        MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, work_comm, &flag, &status);
+        while (flag) {
+            atende_mensagem(&status);
+            MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, work_comm, &flag, &status);
+        }
+        if (deterministic) confere_ordem();
+        if (checkpoint_due && !stop_announced) {
+            grava_checkpoint(g);
+            last_checkpoint = get_time();
+        }
+        // Só o relógio do processo 0 conta; os demais param pelo anúncio
+        if (expired && !stop_announced) encerra_por_tempo(g);
+        return stop_announced;
+    }
+    
+    MPI_Test(&stop_req, &flag, MPI_STATUS_IGNORE);
+    if (flag) {
+        global_stop = 1;
+        solution_owner = stop_rank;
+        if (stop_rank >= 0) global_solution_found = 1;
+        return 1;
+    }
+    if (checkpoint_due) {
+        envia_estado(g);
+        last_checkpoint = get_time();
+    }
+    return 0;
+}
+
+/*
+ * Avisa que este processo encontrou solução
+ * No processo 0 anuncia diretamente; nos demais envia um único aviso ao
+ * processo 0. O envio é síncrono (Issend) para que sua conclusão garanta
+ * que o aviso foi recebido antes de entrar na barreira final.
+ */
+void avisa_parada() {
+    global_stop = 1; // Sinaliza parada global
+    
+    if (rank == 0)
+        anuncia_parada(0);
+    else
+        MPI_Issend(&rank, 1, MPI_INT, 0, TAG_PARADA, work_comm, &aviso_req);
+}
+
+/*
+ * Compara as peças dos níveis 0..depth-1 de s com ordered_path (-d)
+ * Retorna 1 se s já passou da solução guardada na ordem dos candidatos:
+ * como a busca avança em ordem crescente, tudo o que resta a s (e o que
+ * pode ser roubado de s) vem depois dela
+ */
+int depois_da_ordem(search *s, unsigned int depth) {
+    int after = 0;
+    while (atomic_flag_test_and_set_explicit(&ordem_lock, memory_order_acquire));
+    for (unsigned int d = 0; d < depth; d++) {
+        unsigned short ref = s->board[s->order[d]];
+        if (ref != ordered_path[d]) {
+            after = ref > ordered_path[d];
+            break;
+        }
+    }
+    atomic_flag_clear_explicit(&ordem_lock, memory_order_release);
+    return after;
+}
+
+/*
+ * Guarda a solução completa de s em ordered_path se ela vem antes da atual
+ * (-d); a thread segue então como se sua tarefa tivesse acabado
+ */
+void propoe_solucao(game *g, search *s) {
+    while (atomic_flag_test_and_set_explicit(&ordem_lock, memory_order_acquire));
+    int first = atomic_load(&ordered_thread) < 0;
+    for (unsigned int d = 0; d < g->ncells && !first; d++) {
+        unsigned short ref = s->board[s->order[d]];
+        if (ref != ordered_path[d]) {
+            first = ref < ordered_path[d];
+            break;
+        }
+    }
+    if (first) {
+        for (unsigned int d = 0; d < g->ncells; d++)
+            ordered_path[d] = s->board[s->order[d]];
+        atomic_store(&ordered_thread, s->id);
+    }
+    atomic_flag_clear_explicit(&ordem_lock, memory_order_release);
+}
+
+/*
+ * Indica se a busca da thread deve parar: outra thread do processo já
+ * encontrou solução (com -d, uma anterior a tudo o que resta à thread), ou
+ * outro processo avisou que encontrou
+ * A thread 0 verifica as mensagens MPI; as demais leem as flags e param
+ * aqui se a thread 0 pediu uma pausa (s->depth já deve estar atualizado)
+ */
+int deve_parar(game *g, search *s) {
+    if (winner >= 0) return 1;
+    if (deterministic && atomic_load(&ordered_thread) >= 0 && depois_da_ordem(s, s->depth))
+        return 1;
+    
+    atomic_store_explicit(&s->reported_nodes, s->stats.nodes, memory_order_relaxed);
+    atomic_store_explicit(&s->reported_depth, s->stats.max_depth, memory_order_relaxed);
+    
+    // Ajusta o intervalo para uma verificação a cada POLL_SECONDS
+    double now = get_time();
+    double elapsed = now - s->last_poll;
+    s->last_poll = now;
+    if (elapsed < POLL_SECONDS / 2 && s->poll_nodes < POLL_MAX)
+        s->poll_nodes *= 2;
+    else if (elapsed > POLL_SECONDS * 2 && s->poll_nodes > POLL_MIN)
+        s->poll_nodes /= 2;
+    
+    if (s->id == 0) return verifica_parada(g);
+    if (atomic_load(&pausa)) aguarda_pausa();
+    return global_stop || global_solution_found;
+}
+
+/*
+ * Guarda o tabuleiro atual de s, com depth peças colocadas, como o melhor
+ * parcial da thread (-p); só é chamada quando a busca passa da maior
+ * profundidade já alcançada, no máximo ncells vezes por busca
+ */
+void guarda_parcial(game *g, search *s, unsigned int depth) {
+    memcpy(s->best, s->board, g->stride * g->stride * sizeof(unsigned short));
+    atomic_store_explicit(&s->best_depth, depth, memory_order_relaxed);
+}
+
+/*
+ * Copia para refs, linha por linha, o melhor tabuleiro parcial entre as
+ * threads do processo (EMPTY nas células vazias)
+ * Retorna o número de peças desse tabuleiro
+ */
+unsigned int melhor_parcial(game *g, unsigned short *refs) {
+    search *best = &workers[0];
+    for (int t = 1; t < nthreads; t++)
+        if (workers[t].best_depth > best->best_depth) best = &workers[t];
+    for (unsigned int y = 0; y < g->size; y++)
+        for (unsigned int x = 0; x < g->size; x++)
+            refs[y * g->size + x] = best->best_depth ? best->best[CELL(g, x, y)] : EMPTY;
+    return best->best_depth;
+}
+
+/*
+ * Núcleo da busca
+ * As funções *_k recebem o número de palavras dos bitsets (words) e a
+ * largura do tabuleiro (stride) como parâmetros e são sempre expandidas em
+ * quem as chama. Com as constantes de um tamanho (ver KERNEL), os laços por
+ * palavra são desenrolados e os deslocamentos até os vizinhos e a posição
+ * da quina viram imediatos; com os valores de game, formam o caminho
+ * genérico, usado nos demais tamanhos e fora do laço da busca.
+ */
+
+/*
+ * Calcula em mask o bitset de candidatos da célula cell no estado atual:
+ * peças disponíveis, compatíveis com todo vizinho já colocado e com o anel
+ * Os laços por palavra não têm dependências entre iterações e mask não se
+ * sobrepõe aos bitsets lidos; na versão AVX2 de KERNEL_CLONES, o compilador
+ * os vetoriza quando o número de palavras é múltiplo de 4 (em -O2, sem laço
+ * de resto).
+ * Retorna diferente de 0 se há algum candidato
+ */
+ALWAYS_INLINE uint64_t candidatos_k(game *game, search *s, unsigned int cell, uint64_t *restrict mask,
+                                    unsigned int words, unsigned int stride) {
+    const int offset[4] = { -(int)stride, 1, (int)stride, -1 };
+    // Na quina superior esquerda, só as rotações da quina canônica; nas
+    // demais, as rotações distintas
+    const uint64_t *allowed = (cell == stride + 1) ? game->root_mask : game->distinct;
+    for (unsigned int i = 0; i < words; i++)
+        mask[i] = s->avail[i] & allowed[i];
+    
+    for (int side = 0; side < 4; side++) {
+        unsigned short nb = s->board[cell + offset[side]];
+        if (nb == EMPTY) continue;
+        // A cor que o vizinho mostra para esta célula (0 para o anel), como
+        // em SIDE_MASK
+        unsigned int color = X_COLOR(game->pieces[nb], (side + 2) % 4);
+        const uint64_t *m = game->side_mask + (side * (game->ncolors + 1) + color) * words;
+        for (unsigned int i = 0; i < words; i++)
+            mask[i] &= m[i];
+    }
+    
+    uint64_t any = 0;
+    for (unsigned int i = 0; i < words; i++)
+        any |= mask[i];
+    return any;
+}
+
+uint64_t candidatos_da_celula(game *game, search *s, unsigned int cell, uint64_t *mask) {
+    return candidatos_k(game, s, cell, mask, game->words, game->stride);
+}
+
+/*
+ * Retorna o número de bits ligados de mask
+ */
+ALWAYS_INLINE unsigned int conta_bits_k(const uint64_t *mask, unsigned int words) {
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < words; i++)
+        count += __builtin_popcountll(mask[i]);
+    return count;
+}
+
+/*
+ * Retorna a posição do primeiro bit ligado de mask em [n, e), ou e se não há
+ */
+unsigned int proximo_bit(const uint64_t *mask, unsigned int n, unsigned int e) {
+    if (n >= e) return e;
+    unsigned int i = n / WORD_BITS;
+    uint64_t bits = mask[i] & (~0ULL << (n % WORD_BITS));
+    while (!bits) {
+        if (++i * WORD_BITS >= e) return e;
+        bits = mask[i];
+    }
+    unsigned int r = i * WORD_BITS + __builtin_ctzll(bits);
+    return r < e ? r : e;
+}
+
+/*
+ * Escolhe a célula da profundidade d e a grava em s->order[d]
+ * Nas ordens estáticas é a mesma para toda busca; com -o mrv é a célula
+ * vazia com menos candidatos vivos (livres e compatíveis com os vizinhos,
+ * contados com popcount); empates ficam com a primeira em ordem de
+ * varredura
+ * Retorna a célula escolhida
+ */
+ALWAYS_INLINE unsigned int escolhe_celula_k(game *game, search *s, unsigned int d,
+                                            unsigned int words, unsigned int stride) {
+    if (cell_order != ORDEM_MRV) return s->order[d] = game->order[d];
+    
+    unsigned int chosen = 0, best = ~0u;
+    for (unsigned int i = 0; i < game->tile_count && best > 0; i++) {
+        unsigned int cell = game->order[i];
+        if (s->board[cell] != EMPTY) continue;
+        unsigned int live = 0;
+        if (candidatos_k(game, s, cell, s->scratch, words, stride))
+            live = conta_bits_k(s->scratch, words);
+        if (live < best) {
+            best = live;
+            chosen = cell;
+        }
+    }
+    return s->order[d] = chosen;
+}
+
+unsigned int escolhe_celula(game *game, search *s, unsigned int d) {
+    return escolhe_celula_k(game, s, d, game->words, game->stride);
+}
+
+/*
+ * Prepara o nível d da pilha com os candidatos da célula da profundidade d:
+ * calcula seu bitset e publica o intervalo de posições [primeiro, último + 1)
+ * A publicação do intervalo com release garante que um ladrão que o leia
+ * também veja as peças (e células) do prefixo já colocadas no tabuleiro.
+ */
+ALWAYS_INLINE void open_frame_k(game *game, search *s, unsigned int d,
+                                unsigned int words, unsigned int stride) {
+    uint64_t *mask = s->masks + d * words;
+    unsigned int start = 0, end = 0;
+    if (candidatos_k(game, s, escolhe_celula_k(game, s, d, words, stride), mask, words, stride)) {
+        start = proximo_bit(mask, 0, 4 * game->tile_count);
+        for (unsigned int i = words; i-- > 0;)
+            if (mask[i]) {
+                end = i * WORD_BITS + WORD_BITS - __builtin_clzll(mask[i]);
+                break;
+            }
+    } else {
+        s->stats.dead_ends++;
+    }
+    // Nível novo: ainda não tem solução nem foi roubado (antes de publicá-lo)
+    if (dead_cache) {
+        unsigned int t = atomic_load_explicit(&s->tainted, memory_order_relaxed);
+        while (t > d && !atomic_compare_exchange_weak(&s->tainted, &t, d));
+    }
+    unsigned long long old = atomic_load_explicit(&s->stack[d].range, memory_order_relaxed);
+    atomic_store_explicit(&s->stack[d].range, RANGE(start, end, R_GEN(old) + 1),
+                          memory_order_release);
+}
+
+void open_frame(game *game, search *s, unsigned int d) {
+    open_frame_k(game, s, d, game->words, game->stride);
+}
+
+/*
+ * Monta a ordem estática de visita das células segundo cell_order
+ * linha: varredura linha a linha; moldura: toda a borda no sentido horário
+ * a partir da quina superior esquerda e depois o interior por linhas;
+ * espiral: cada anel no sentido horário, de fora para dentro. Em todas, a
+ * quina superior esquerda vem primeiro.
+ */
+void build_order(game *g) {
+    g->offset[0] = -(int)g->stride; // Norte
+    g->offset[1] = 1;               // Leste
+    g->offset[2] = g->stride;       // Sul
+    g->offset[3] = -1;              // Oeste
+    
+    g->order = malloc(g->tile_count * sizeof(unsigned int));
+    g->ncells = 0;
+    unsigned int layers = 0;
+    if (cell_order == ORDEM_MOLDURA) layers = 1;
+    if (cell_order == ORDEM_ESPIRAL) layers = (g->size + 1) / 2;
+    for (unsigned int l = 0; l < layers && l < (g->size + 1) / 2; l++) {
+        unsigned int lo = l, hi = g->size - 1 - l;
+        if (lo == hi) {
+            g->order[g->ncells++] = CELL(g, lo, lo);
+            break;
+        }
+        for (unsigned int x = lo; x <= hi; x++) g->order[g->ncells++] = CELL(g, x, lo);
+        for (unsigned int y = lo + 1; y <= hi; y++) g->order[g->ncells++] = CELL(g, hi, y);
+        for (unsigned int x = hi; x-- > lo;) g->order[g->ncells++] = CELL(g, x, hi);
+        for (unsigned int y = hi; --y > lo;) g->order[g->ncells++] = CELL(g, lo, y);
+    }
+    for (unsigned int y = layers; y + layers < g->size; y++)
+        for (unsigned int x = layers; x + layers < g->size; x++)
+            g->order[g->ncells++] = CELL(g, x, y);
+    assert(g->ncells == g->tile_count);
+    g->steal_limit = 0;
+    g->frontier = g->ncells;
+}
+
+/*
+ * Prepara uma busca que preenche as células order[base..ncells-1]
+ */
+void start_search(game *game, search *s, unsigned int base) {
+    s->base = s->depth = base;
+    if (base < game->ncells)
+        open_frame(game, s, base);
+}
+
+/*
+ * Algoritmo principal de backtracking para resolver o puzzle
+ * Versão iterativa sobre a pilha explícita: nenhuma recursão, e o estado
+ * completo da busca (tabuleiro, flags de uso e cursores de candidatos) fica
+ * em search, podendo ser pausado, retomado, serializado ou dividido.
+ * Nos níveis abaixo de steal_limit o próximo candidato é tomado com CAS,
+ * pois um ladrão pode encurtar o intervalo ao mesmo tempo; nos demais a
+ * thread é a única a tocar no nível e basta uma escrita simples.
+ * A cada poll_nodes nós verifica se a busca deve parar. Com -m, não desce
+ * a estados da tabela de becos sem saída e guarda nela os que esgota.
+ * Retorna 1 se encontrou solução (tabuleiro completo ou, com -g, preenchido
+ * até frontier), 0 caso contrário.
+ * Pode ser chamada de novo após uma solução para continuar a busca.
+ */
+ALWAYS_INLINE int play_k(game *game, search *s, unsigned int words, unsigned int stride) {
+    unsigned int d = s->depth;
+    unsigned int nodes = 0;
+    
+    if (d == game->frontier) {
+        // Retomada após uma solução: remove a última peça e continua
+        if (d == s->base) return 0;
+        d--;
+        retira_peca(game, s, s->order[d]);
+    }
+    
+    for (;;) {
+        // Verificação periódica de parada
+        if (++nodes >= s->poll_nodes) {
+            nodes = 0;
+            s->depth = d; // A pilha fica consistente para um checkpoint
+            if (deve_parar(game, s))
+                return 0; // Para o backtracking imediatamente
+        }
+        
+        // Toma o próximo candidato do bitset do nível (já livre e compatível
+        // com os vizinhos) e o coloca; com -f, confere também as cores das
+        // peças restantes
+        frame *f = &s->stack[d];
+        const uint64_t *mask = s->masks + d * words;
+        unsigned int cell = s->order[d];
+        unsigned short ref = EMPTY;
+        unsigned long long w = atomic_load_explicit(&f->range, memory_order_relaxed);
+        while (R_NEXT(w) < R_END(w)) {
+            unsigned int e = R_END(w);
+            unsigned int r = proximo_bit(mask, R_NEXT(w), e);
+            unsigned long long taken = RANGE(r < e ? r + 1 : e, e, R_GEN(w));
+            if (d < game->steal_limit) {
+                if (!atomic_compare_exchange_weak_explicit(&f->range, &w, taken,
+                                                           memory_order_acq_rel,
+                                                           memory_order_relaxed))
+                    continue; // Intervalo roubado ou CAS espúrio: w foi relido
+            } else {
+                atomic_store_explicit(&f->range, taken, memory_order_relaxed);
+            }
+            w = taken;
+            if (r >= e) break;
+            s->stats.candidates++;
+            coloca_peca(game, s, cell, r);
+            if (!forward_checking || bordas_ok(game, s, r)) {
+                ref = r;
+                break;
+            }
+            s->stats.fc_rejects++;
+            retira_peca(game, s, cell);
+        }
+        
+        if (ref != EMPTY) {
+            // Desce um nível
+            s->stats.nodes++;
+            s->depth_nodes[d]++;
+            if (d + 1 > s->stats.max_depth) {
+                s->stats.max_depth = d + 1;
+                if (partial_mode && d + 1 > s->best_depth) guarda_parcial(game, s, d + 1);
+            }
+            if (++d == game->frontier) {
+                // Completou o tabuleiro (ou, com -g, chegou à fronteira)
+                if (dead_cache) marca_incompleto(s, d);
+                s->depth = d;
+                return 1;
+            }
+            if (dead_cache && d + CACHE_MIN_CELLS <= game->ncells && beco_conhecido(s->hash)) {
+                // Estado já esgotado sem solução: retira a peça e segue no nível
+                s->stats.cache_hits++;
+                retira_peca(game, s, s->order[--d]);
+                continue;
+            }
+            open_frame_k(game, s, d, words, stride);
+        } else {
+            // Nenhum candidato restante neste nível: retrocede (backtrack)
+            if (d == s->base) {
+                s->depth = d;
+                return 0;
+            }
+            // O nível foi esgotado: se inteiro e sem solução, o estado vai
+            // para a tabela. A barreira garante ver a marca de um ladrão que
+            // encurtou o intervalo lido (ver rouba_trabalho)
+            if (dead_cache && d + CACHE_MIN_CELLS <= game->ncells) {
+                atomic_thread_fence(memory_order_acquire);
+                if (atomic_load_explicit(&s->tainted, memory_order_relaxed) <= d)
+                    guarda_beco(s->hash);
+            }
+            d--;
+            retira_peca(game, s, s->order[d]);
+        }
+    }
+}
+
+/*
+ * Instancia play_k para o tamanho n: play_<n> usa o número de palavras e a
+ * largura do tabuleiro de n como constantes (e tem as versões de
+ * KERNEL_CLONES)
+ */
+#define KERNEL(n) \
+    KERNEL_CLONES int play_##n(game *game, search *s) { \
+        return play_k(game, s, KERNEL_WORDS(n), (n) + 2); \
+    }
+
+KERNEL(4) KERNEL(5) KERNEL(6) KERNEL(7) KERNEL(8) KERNEL(9) KERNEL(10)
+KERNEL(11) KERNEL(12) KERNEL(13) KERNEL(14) KERNEL(15) KERNEL(16)
+
+int (*const kernels[KERNEL_MAX - KERNEL_MIN + 1])(game *, search *) = {
+    play_4, play_5, play_6, play_7, play_8, play_9, play_10,
+    play_11, play_12, play_13, play_14, play_15, play_16
+};
+
+/*
+ * Busca a partir do estado de s com o núcleo do tamanho do tabuleiro (ver
+ * play_k), ou com o genérico nos tamanhos fora de KERNEL_MIN..KERNEL_MAX
+ */
+int play(game *game, search *s) {
+    if (game->size >= KERNEL_MIN && game->size <= KERNEL_MAX)
+        return kernels[game->size - KERNEL_MIN](game, s);
+    return play_k(game, s, game->words, game->stride);
+}
+
+/*
+ * Esvazia o estado de busca de uma thread: remove as peças colocadas (da
+ * última para a primeira, como exige retira_peca) e fecha todos os níveis
+ * ainda abertos, para que nada mais possa ser roubado
+ */
+void limpa_busca(game *g, search *s) {
+    unsigned int top = s->depth < g->ncells ? s->depth : g->ncells - 1;
+    for (unsigned int d = top + 1; d-- > 0;) {
+        if (d < s->depth) retira_peca(g, s, s->order[d]);
+        unsigned long long w = atomic_load_explicit(&s->stack[d].range, memory_order_relaxed);
+        atomic_store_explicit(&s->stack[d].range, RANGE(0, 0, R_GEN(w) + 1),
+                              memory_order_relaxed);
+    }
+    s->depth = s->base = 0;
+}
+
+/*
+ * Tenta roubar trabalho de outra thread do processo
+ * Percorre as vítimas procurando o nível mais raso (abaixo de steal_limit)
+ * que ainda tem candidatos, copia o prefixo da vítima até esse nível e toma
+ * para si a metade final [mid, end) do intervalo com um CAS. Se o CAS
+ * falha, a vítima avançou e a cópia do prefixo é descartada.
+ * A thread deixa de contar como ociosa antes do CAS, de modo que nunca há
+ * trabalho em trânsito enquanto idle_threads == nthreads.
+ * Retorna 1 se roubou (o estado de s fica pronto para play()), 0 caso contrário.
+ */
+int rouba_trabalho(game *g, search *s) {
+    for (int k = 1; k < nthreads; k++) {
+        search *v = &workers[(s->id + k) % nthreads];
+        for (unsigned int d = 0; d < g->steal_limit; d++) {
+            frame *f = &v->stack[d];
+            unsigned long long w = atomic_load_explicit(&f->range, memory_order_acquire);
+            unsigned int n = R_NEXT(w), e = R_END(w);
+            if (n >= e) continue;
+            
+            // Prefixo da vítima: os níveis acima de d estão fixos enquanto
+            // o intervalo do nível d não mudar, o que o CAS confirma. As
+            // células vão direto para s->order, sem uso enquanto s está ociosa.
+            for (unsigned int i = 0; i < d; i++) {
+                s->order[i] = __atomic_load_n(&v->order[i], __ATOMIC_RELAXED);
+                s->steal_buf[i] = __atomic_load_n(&v->board[s->order[i]], __ATOMIC_RELAXED);
+            }
+            s->order[d] = __atomic_load_n(&v->order[d], __ATOMIC_RELAXED);
+            
+            unsigned int mid = n + (e - n) / 2;
+            atomic_fetch_sub(&idle_threads, 1);
+            // Com -m, o nível d e os de cima deixam de ser esgotados por
+            // inteiro pela vítima; a marca vem antes do CAS, que a publica
+            if (dead_cache) marca_incompleto(v, d + 1);
+            if (atomic_compare_exchange_strong_explicit(&f->range, &w, RANGE(n, mid, R_GEN(w)),
+                                                        memory_order_acq_rel,
+                                                        memory_order_relaxed)) {
+                for (unsigned int i = 0; i < d; i++)
+                    coloca_peca(g, s, s->order[i], s->steal_buf[i]);
+                s->base = s->depth = d;
+                s->stats.steals++;
+                
+                // O bitset do nível d depende só do prefixo, que agora é o
+                // mesmo da vítima; a thread fica com as posições [mid, end)
+                unsigned long long own = atomic_load_explicit(&s->stack[d].range,
+                                                              memory_order_relaxed);
+                candidatos_da_celula(g, s, s->order[d], s->masks + d * g->words);
+                atomic_store_explicit(&s->stack[d].range, RANGE(mid, e, R_GEN(own) + 1),
+                                      memory_order_release);
+                return 1;
+            }
+            atomic_fetch_add(&idle_threads, 1);
+            break; // A vítima mudou: tenta a próxima
+        }
+    }
+    return 0;
+}
+
+/*
+ * Escreve no buffer de s o número n seguido de sep
+ */
+void escreve_numero(search *s, unsigned int n, char sep) {
+    char digits[10];
+    int len = 0;
+    do {
+        digits[len++] = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    while (len) s->out_buf[s->out_len++] = digits[--len];
+    s->out_buf[s->out_len++] = sep;
+}
+
+/*
+ * Registra a solução completa no tabuleiro de s (-c/-e)
+ * Com -e, acrescenta ao buffer da thread a solução no formato de
+ * print_solution (e, com -r, também suas rotações de 90, 180 e 270 graus),
+ * separadas por linha em branco. Girar o tabuleiro no sentido horário leva
+ * a célula (x, y) para (size - 1 - y, x) e soma 1 à rotação de cada peça.
+ */
+void registra_solucao(game *g, search *s) {
+    int rotations = all_rotations ? 4 : 1;
+    s->solutions += rotations;
+    if (count_mode != 2) return;
+    
+    for (int k = 0; k < rotations; k++) {
+        // Cada célula ocupa no máximo 10 + 1 + 1 + 1 bytes
+        if (s->out_len + 13 * g->tile_count + 1 > SOLUTION_BUF) descarrega_solucoes(s);
+        for (unsigned int y = 0; y < g->size; y++)
+            for (unsigned int x = 0; x < g->size; x++) {
+                unsigned int cx = x, cy = y;
+                for (int i = 0; i < k; i++) {
+                    unsigned int t = cx;
+                    cx = cy;
+                    cy = g->size - 1 - t;
+                }
+                unsigned short ref = s->board[CELL(g, cx, cy)];
+                escreve_numero(s, PIECE_ID(ref), ' ');
+                escreve_numero(s, (PIECE_ROT(ref) + k) % 4, '\n');
+            }
+        s->out_buf[s->out_len++] = '\n';
+    }
+}
+
+/*
+ * Prepara as subárvores do dispositivo (-g): escolhe frontier, monta as
+ * tabelas de candidatos, copia-as para o acelerador do processo e aloca o
+ * lote de cada thread
+ * A fronteira fica gpu_cells níveis antes do fim, mas sempre abaixo dos
+ * prefixos das unidades e de steal_limit, e só em níveis cujas células já
+ * têm dois vizinhos preenchidos (em todas as ordens estáticas, menos a
+ * primeira célula). Com vários processos no mesmo nó, cada um usa um
+ * acelerador diferente, em rodízio.
+ */
+void prepara_gpu(game *g) {
+    unsigned int frontier = g->ncells > gpu_cells ? g->ncells - gpu_cells : 0;
+    if (frontier <= (unsigned int)work_depth) frontier = work_depth + 1;
+    
+    // Posição de cada célula na ordem de visita; o anel conta como preenchido
+    unsigned int *position = malloc(g->stride * g->stride * sizeof(unsigned int));
+    for (unsigned int c = 0; c < g->stride * g->stride; c++) position[c] = 0;
+    for (unsigned int d = 0; d < g->ncells; d++) position[g->order[d]] = d + 1;
+    gpu_pair = malloc(g->ncells);
+    for (unsigned int d = g->ncells; d-- > frontier;) {
+        int sides[4], placed = 0;
+        for (int side = 0; side < 4; side++)
+            if (position[g->order[d] + g->offset[side]] <= d) sides[placed++] = side;
+        if (placed < 2) {
+            frontier = d + 1;
+            break;
+        }
+        for (int p = 0; p < 6; p++)
+            if (gpu_sides[p][0] == sides[0] && gpu_sides[p][1] == sides[1]) gpu_pair[d] = p;
+    }
+    free(position);
+    if (frontier >= g->ncells) {
+        gpu_cells = 0;
+        free(gpu_pair);
+        gpu_pair = NULL;
+        return;
+    }
+    g->frontier = frontier;
+    if (g->steal_limit > frontier) g->steal_limit = frontier;
+    
+    // Contagem das referências por chave e, depois, as listas
+    gpu_keys = 6 * (g->ncolors + 1) * (g->ncolors + 1);
+    gpu_cand_start = calloc(gpu_keys + 1, sizeof(unsigned int));
+    for (int p = 0; p < 6; p++)
+        for (unsigned int ref = 0; ref < 4 * g->tile_count; ref++)
+            if (g->distinct[ref / WORD_BITS] >> (ref % WORD_BITS) & 1)
+                gpu_cand_start[GPU_KEY(g, p, X_COLOR(g->pieces[ref], gpu_sides[p][0]),
+                                       X_COLOR(g->pieces[ref], gpu_sides[p][1])) + 1]++;
+    for (unsigned int k = 0; k < gpu_keys; k++) gpu_cand_start[k + 1] += gpu_cand_start[k];
+    gpu_ncand = gpu_cand_start[gpu_keys];
+    gpu_cand = malloc((gpu_ncand + 1) * sizeof(unsigned short));
+    unsigned int *fill = malloc(gpu_keys * sizeof(unsigned int));
+    memcpy(fill, gpu_cand_start, gpu_keys * sizeof(unsigned int));
+    for (int p = 0; p < 6; p++)
+        for (unsigned int ref = 0; ref < 4 * g->tile_count; ref++)
+            if (g->distinct[ref / WORD_BITS] >> (ref % WORD_BITS) & 1)
+                gpu_cand[fill[GPU_KEY(g, p, X_COLOR(g->pieces[ref], gpu_sides[p][0]),
+                                      X_COLOR(g->pieces[ref], gpu_sides[p][1]))]++] = ref;
+    free(fill);
+    gpu_prev = malloc(g->tile_count * sizeof(int));
+    for (unsigned int i = 0; i < g->tile_count; i++) gpu_prev[i] = -1;
+    for (unsigned int i = 0; i < g->tile_count; i++)
+        if (g->next_copy[i] >= 0) gpu_prev[g->next_copy[i]] = i;
+    
+    for (int t = 0; t < nthreads; t++) {
+        workers[t].gpu_buf = malloc(GPU_BATCH * frontier * sizeof(unsigned short));
+        workers[t].gpu_len = 0;
+    }
+    
+#ifdef _OPENMP
+    gpu_devices = omp_get_num_devices();
+    if (gpu_devices > 0) {
+        MPI_Comm local;
+        int local_rank;
+        MPI_Comm_split_type(work_comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &local);
+        MPI_Comm_rank(local, &local_rank);
+        MPI_Comm_free(&local);
+        omp_set_default_device(local_rank % gpu_devices);
+    }
+    gpu_pieces = g->pieces;
+    gpu_order = g->order;
+    #pragma omp target enter data map(to: gpu_pieces[0:4 * g->tile_count + 1], \
+        gpu_order[0:g->ncells], gpu_cand[0:gpu_ncand + 1], gpu_cand_start[0:gpu_keys + 1], \
+        gpu_pair[0:g->ncells], gpu_prev[0:g->tile_count])
+#endif
+}
+
+/*
+ * Libera as tabelas do dispositivo (-g)
+ */
+void libera_gpu(game *g) {
+    if (!gpu_cells) return;
+#ifdef _OPENMP
+    #pragma omp target exit data map(delete: gpu_pieces[0:4 * g->tile_count + 1], \
+        gpu_order[0:g->ncells], gpu_cand[0:gpu_ncand + 1], gpu_cand_start[0:gpu_keys + 1], \
+        gpu_pair[0:g->ncells], gpu_prev[0:g->tile_count])
+#endif
+    free(gpu_cand);
+    free(gpu_cand_start);
+    free(gpu_pair);
+    free(gpu_prev);
+}
+
+/*
+ * Completa no dispositivo as subárvores do lote de s (-g): cada thread do
+ * dispositivo monta o tabuleiro de um prefixo e faz sobre ele o mesmo
+ * backtracking iterativo de play(), com candidatos tirados das tabelas por
+ * par de vizinhos e as mesmas regras das cópias de peças, numa pilha
+ * própria. Com -c, soma as soluções de todos os prefixos; sem -c, a
+ * primeira thread a completar um tabuleiro o guarda e as demais param.
+ * O lote é descartado se a busca já deve parar.
+ * Retorna 1 se encontrou solução, que passa a ser o tabuleiro de s
+ */
+int descarrega_fronteira(game *g, search *s) {
+    unsigned int len = s->gpu_len;
+    s->gpu_len = 0;
+    if (!len || winner >= 0 || global_stop || global_solution_found) return 0;
+    
+    piece *pieces = g->pieces;
+    unsigned int *order = g->order;
+    unsigned int ncells = g->ncells, tiles = g->tile_count;
+    unsigned int frontier = g->frontier, stride = g->stride, area = stride * stride;
+    unsigned int ncolors = g->ncolors, rest = ncells - frontier;
+    int offset[4] = { g->offset[0], g->offset[1], g->offset[2], g->offset[3] };
+    unsigned int border = BORDER(g);
+    int count_all = count_mode != 0;
+    unsigned short *cand = gpu_cand, *prefix = s->gpu_buf;
+    unsigned int *cand_start = gpu_cand_start;
+    unsigned char *pair = gpu_pair;
+    int *prev = gpu_prev;
+    unsigned short *solution = malloc(ncells * sizeof(unsigned short));
+    int solved = 0;
+    unsigned long long solutions = 0, nodes = 0;
+    
+    // Tabuleiro, peças usadas e pilha de cada prefixo, só no dispositivo
+    unsigned short *boards = malloc((size_t)len * area * sizeof(unsigned short));
+    unsigned char *used = malloc((size_t)len * tiles);
+    unsigned int *stack = malloc((size_t)len * 2 * rest * sizeof(unsigned int));
+    
+#ifdef _OPENMP
+    #pragma omp target teams distribute parallel for \
+        map(to: pieces[0:4 * tiles + 1], order[0:ncells], cand[0:gpu_ncand + 1], \
+            cand_start[0:gpu_keys + 1], pair[0:ncells], prev[0:tiles], prefix[0:len * frontier]) \
+        map(alloc: boards[0:len * area], used[0:len * tiles], stack[0:len * 2 * rest]) \
+        map(tofrom: solved, solution[0:ncells]) reduction(+: solutions, nodes)
+#endif
+    for (unsigned int i = 0; i < len; i++) {
+        unsigned short *b = boards + (size_t)i * area;
+        unsigned char *u = used + (size_t)i * tiles;
+        unsigned int *next = stack + (size_t)i * 2 * rest, *end = next + rest;
+        for (unsigned int c = 0; c < area; c++) {
+            unsigned int x = c % stride, y = c / stride;
+            b[c] = (x == 0 || y == 0 || x == stride - 1 || y == stride - 1) ? border : EMPTY;
+        }
+        for (unsigned int t = 0; t < tiles; t++) u[t] = 0;
+        for (unsigned int d = 0; d < frontier; d++) {
+            unsigned short ref = prefix[(size_t)i * frontier + d];
+            b[order[d]] = ref;
+            u[PIECE_ID(ref)] = 1;
+        }
+        
+        // Abre um nível: candidatos pelas cores do par de vizinhos preenchidos
+        #define GPU_OPEN(d) do { \
+            unsigned int cell_ = order[d], p_ = pair[d], k_ = d - frontier; \
+            unsigned int a_ = X_COLOR(pieces[b[cell_ + offset[gpu_sides[p_][0]]]], (gpu_sides[p_][0] + 2) % 4); \
+            unsigned int c_ = X_COLOR(pieces[b[cell_ + offset[gpu_sides[p_][1]]]], (gpu_sides[p_][1] + 2) % 4); \
+            unsigned int key_ = (p_ * (ncolors + 1) + a_) * (ncolors + 1) + c_; \
+            next[k_] = cand_start[key_]; \
+            end[k_] = cand_start[key_ + 1]; \
+        } while (0)
+        unsigned int d = frontier;
+        GPU_OPEN(d);
+        for (;;) {
+            int stop;
+#ifdef _OPENMP
+            #pragma omp atomic read
+#endif
+            stop = solved;
+            if (stop) break;
+            
+            unsigned int k = d - frontier, cell = order[d];
+            unsigned short ref = EMPTY;
+            while (next[k] < end[k]) {
+                unsigned short r = cand[next[k]++];
+                unsigned int t = PIECE_ID(r);
+                // Livre, e a cópia anterior (se houver) já usada
+                if (u[t] || (prev[t] >= 0 && !u[prev[t]])) continue;
+                piece p = pieces[r];
+                int fits = 1;
+                for (int side = 0; side < 4 && fits; side++) {
+                    unsigned short n = b[cell + offset[side]];
+                    if (n != EMPTY && X_COLOR(pieces[n], (side + 2) % 4) != X_COLOR(p, side))
+                        fits = 0;
+                }
+                if (fits) {
+                    ref = r;
+                    break;
+                }
+            }
+            if (ref != EMPTY) {
+                nodes++;
+                b[cell] = ref;
+                u[PIECE_ID(ref)] = 1;
+                if (++d < ncells) {
+                    GPU_OPEN(d);
+                    continue;
+                }
+                // Tabuleiro completo
+                if (!count_all) {
+                    int first;
+#ifdef _OPENMP
+                    #pragma omp atomic capture
+#endif
+                    { first = solved; solved = 1; }
+                    if (!first)
+                        for (unsigned int c = 0; c < ncells; c++) solution[c] = b[order[c]];
+                    break;
+                }
+                solutions++;
+                d--;
+            } else if (d == frontier) {
+                break;
+            } else {
+                d--;
+            }
+            u[PIECE_ID(b[order[d]])] = 0;
+            b[order[d]] = EMPTY;
+        }
+        #undef GPU_OPEN
+    }
+    free(boards);
+    free(used);
+    free(stack);
+    
+    s->stats.nodes += nodes;
+    s->solutions += solutions * (all_rotations ? 4 : 1);
+    if (solved) {
+        limpa_busca(g, s);
+        for (unsigned int d = 0; d < ncells; d++) coloca_peca(g, s, order[d], solution[d]);
+        s->depth = ncells;
+    }
+    free(solution);
+    return solved;
+}
+
+/*
+ * Acrescenta ao lote de s o prefixo de s, preenchido até frontier, e envia
+ * o lote ao dispositivo quando ele enche (-g)
+ * Retorna 1 se o lote teve solução, que passa a ser o tabuleiro de s
+ */
+int guarda_fronteira(game *g, search *s) {
+    unsigned short *out = s->gpu_buf + (size_t)s->gpu_len++ * g->frontier;
+    for (unsigned int d = 0; d < g->frontier; d++) out[d] = s->board[s->order[d]];
+    return s->gpu_len == GPU_BATCH && descarrega_fronteira(g, s);
+}
+
+/*
+ * Laço de cada thread durante uma unidade de trabalho
+ * Busca enquanto tiver trabalho próprio; quando esgota, fica ociosa e tenta
+ * roubar de outras threads. A unidade termina quando todas as threads estão
+ * ociosas ao mesmo tempo, ou quando alguma encontra solução (winner).
+ * Com -c/-e, cada solução é registrada e a busca continua; com -d, é
+ * proposta como a primeira da unidade e a thread passa a outra tarefa.
+ * Ociosa, a thread 0 continua verificando as mensagens MPI.
+ */
+void busca_paralela(game *g, int id) {
+    search *s = &workers[id];
+    int has_task = (id == 0);
+    unsigned int spins = 0;
+    
+    while (winner < 0 && !global_stop && !global_solution_found) {
+        if (id != 0 && atomic_load(&pausa)) aguarda_pausa();
+        
+        if (has_task) {
+            // Com -g, play() para na fronteira e o resto vai para o lote,
+            // esvaziado também quando a tarefa acaba
+            while (play(g, s) || descarrega_fronteira(g, s)) {
+                if (s->depth < g->ncells && !guarda_fronteira(g, s)) continue;
+                if (count_mode) {
+                    registra_solucao(g, s);
+                    continue;
+                }
+                if (deterministic) {
+                    propoe_solucao(g, s);
+                    break;
+                }
+                // A primeira a completar o tabuleiro vence; as demais param
+                // na próxima verificação
+                int none = -1;
+                atomic_compare_exchange_strong(&winner, &none, id);
+                return;
+            }
+            limpa_busca(g, s);
+            has_task = 0;
+            atomic_fetch_add(&idle_threads, 1);
+        }
+        
+        if (atomic_load(&idle_threads) == nthreads) return; // Unidade esgotada
+        
+        if (rouba_trabalho(g, s)) {
+            has_task = 1;
+            continue;
+        }
+        if (id == 0 && ++spins % POLL_INTERVAL == 0 && verifica_parada(g)) return;
+        sched_yield();
+    }
+}
+
+/*
+ * Estima pelo método de Knuth o número de nós da subárvore abaixo do estado
+ * atual de s, com depth peças colocadas: cada sondagem desce por um caminho
+ * aleatório, sorteando um dos c candidatos vivos de cada nível, e soma
+ * c1 + c1 c2 + c1 c2 c3 + ..., estimativa sem viés do número de nós que
+ * play() visitaria. s volta ao estado original.
+ * Retorna a média de ESTIMATE_PROBES sondagens
+ */
+double estima_subarvore(game *g, search *s, unsigned int depth, uint64_t *rng) {
+    unsigned int e = 4 * g->tile_count;
+    uint64_t *mask = s->scratch;
+    double total = 0;
+    
+    for (int p = 0; p < ESTIMATE_PROBES; p++) {
+        double weight = 1;
+        unsigned int d = depth;
+        while (d < g->ncells) {
+            // Com -o mrv, escolhe_celula usa scratch antes dos candidatos
+            unsigned int cell = escolhe_celula(g, s, d), live = 0;
+            if (candidatos_da_celula(g, s, cell, mask))
+                for (unsigned int r = proximo_bit(mask, 0, e); r < e; r = proximo_bit(mask, r + 1, e)) {
+                    if (forward_checking) {
+                        coloca_peca(g, s, cell, r);
+                        int ok = bordas_ok(g, s, r);
+                        retira_peca(g, s, cell);
+                        if (!ok) {
+                            mask[r / WORD_BITS] &= ~(1ULL << (r % WORD_BITS));
+                            continue;
+                        }
+                    }
+                    live++;
+                }
+            if (live == 0) break;
+            
+            unsigned int r = proximo_bit(mask, 0, e);
+            for (unsigned int k = sorteia(rng, live); k > 0; k--)
+                r = proximo_bit(mask, r + 1, e);
+            weight *= live;
+            total += weight;
+            coloca_peca(g, s, cell, r);
+            d++;
+        }
+        while (d > depth) {
+            d--;
+            retira_peca(g, s, s->order[d]);
+        }
+    }
+    return total / ESTIMATE_PROBES;
+}
+
+/*
+ * Ordena unit_size do maior para o menor
+ */
+int maior_primeiro(const void *a, const void *b) {
+    double x = ((const unit_size *)a)->size, y = ((const unit_size *)b)->size;
+    return (x < y) - (x > y);
+}
+
+/*
+ * Acrescenta à fila uma unidade com prefixo de depth células e intervalo
+ * [next, end); o prefixo fica a cargo de quem chama
+ * Retorna o registro da unidade (válido até a próxima inclusão)
+ */
+unsigned short *nova_unidade(unsigned int depth, unsigned int next, unsigned int end) {
+    if (units_len + 3 + (int)depth > units_capacity) {
+        units_capacity = 2 * (units_len + 3 + depth);
+        work_units = realloc(work_units, units_capacity * sizeof(unsigned short));
+    }
+    if (num_units == starts_capacity) {
+        starts_capacity = 2 * num_units + 16;
+        unit_start = realloc(unit_start, starts_capacity * sizeof(int));
+    }
+    unit_start[num_units++] = units_len;
+    unsigned short *u = work_units + units_len;
+    UNIT_DEPTH(u) = depth;
+    UNIT_NEXT(u) = next;
+    UNIT_END(u) = end;
+    units_len += UNIT_LEN(u);
+    return u;
+}
+
+/*
+ * Gera as unidades de trabalho (processo 0)
+ * Enumera todos os prefixos válidos das primeiras k células da ordem de
+ * visita, usando o próprio motor de busca (no estado s) limitado à
+ * profundidade k, e estima o tamanho de cada um (estima_subarvore). A
+ * profundidade k é a menor que produz pelo menos UNITS_PER_RANK unidades
+ * por processo e em que nenhuma unidade passa de 1/UNIT_SHARE da parte de
+ * um processo (até UNITS_MAX_PER_RANK unidades por processo), limitada a
+ * ncells - 1 para que toda unidade ainda tenha busca a fazer. As unidades
+ * são entregues da maior para a menor, exceto com -d, que mantém a ordem
+ * da busca serial. Imprime a estimativa do tamanho da árvore inteira.
+ */
+void gera_unidades(game *g, search *s, int nprocs) {
+    unsigned int total = g->ncells;
+    int target = UNITS_PER_RANK * nprocs, limit = UNITS_MAX_PER_RANK * nprocs;
+    uint64_t rng = ESTIMATE_SEED;
+    unit_size *sizes = NULL;
+    int capacity = 0;
+    
+    // Unidade inicial: prefixo vazio (a busca inteira)
+    nova_unidade(0, 0, 4 * g->tile_count);
+    work_depth = 0;
+    double sum = estima_subarvore(g, s, 0, &rng), largest = sum;
+    
+    for (unsigned int k = 1; k < total && (num_units < target ||
+                                           (nprocs > 1 && num_units < limit &&
+                                            largest * UNIT_SHARE * nprocs > sum)); k++) {
+        num_units = units_len = 0;
+        sum = largest = 0;
+        g->frontier = k;
+        start_search(g, s, 0);
+        while (play(g, s)) {
+            unsigned short *u = nova_unidade(k, 0, 4 * g->tile_count);
+            for (unsigned int d = 0; d < k; d++)
+                UNIT_PREFIX(u)[d] = s->board[s->order[d]];
+            
+            if (num_units > capacity) {
+                capacity = 2 * num_units;
+                sizes = realloc(sizes, capacity * sizeof(unit_size));
+            }
+            double size = 1 + estima_subarvore(g, s, k, &rng);
+            sizes[num_units - 1].size = size;
+            sizes[num_units - 1].start = unit_start[num_units - 1];
+            sum += size;
+            if (size > largest) largest = size;
+        }
+        work_depth = k;
+        
+        // Nenhum prefixo possível: o puzzle não tem solução
+        if (num_units == 0) break;
+    }
+    g->frontier = total;
+    
+    if (work_depth > 0 && !deterministic) {
+        qsort(sizes, num_units, sizeof(unit_size), maior_primeiro);
+        for (int i = 0; i < num_units; i++)
+            unit_start[i] = sizes[i].start;
+    }
+    free(sizes);
+    printf("Estimativa da árvore (Knuth, %d sondagens por unidade): %.3g nós; "
+           "maior unidade com %.1f%%\n\n", ESTIMATE_PROBES, sum,
+           sum > 0 ? 100 * largest / sum : 0.0);
+}
+
+/*
+ * Coloca no tabuleiro de s o prefixo da unidade u, escolhendo a célula de
+ * cada nível como a busca escolhe, e confere que cada peça é candidata
+ * Retorna 0 se alguma não é (as anteriores ficam colocadas; s->depth sempre
+ * indica quantas, para limpa_busca)
+ */
+int refaz_prefixo(game *g, search *s, unsigned short *u) {
+    for (unsigned int d = 0; d < UNIT_DEPTH(u); d++) {
+        unsigned int cell = escolhe_celula(g, s, d);
+        unsigned int ref = UNIT_PREFIX(u)[d];
+        s->depth = d;
+        if (ref >= 4 * g->tile_count || !candidatos_da_celula(g, s, cell, s->scratch) ||
+            !(s->scratch[ref / WORD_BITS] >> (ref % WORD_BITS) & 1))
+            return 0;
+        coloca_peca(g, s, cell, ref);
+    }
+    s->depth = UNIT_DEPTH(u);
+    return 1;
+}
+
+/*
+ * Acrescenta à fila uma cópia da unidade u restrita ao intervalo [next, end)
+ */
+void copia_unidade(unsigned short *u, unsigned int next, unsigned int end) {
+    unsigned short *v = nova_unidade(UNIT_DEPTH(u), next, end);
+    memcpy(UNIT_PREFIX(v), UNIT_PREFIX(u), UNIT_DEPTH(u) * sizeof(unsigned short));
+}
+
+/*
+ * Subdivide as unidades da fila (processo 0, na retomada) até ter target
+ * unidades ou não haver mais o que dividir: uma unidade com vários
+ * candidatos restantes se divide nas duas metades deles; com um único,
+ * desce um nível fixando-o; sem nenhum, é descartada
+ */
+void divide_unidades(game *g, search *s, int target) {
+    int changed = 1;
+    while (changed && num_units < target) {
+        unsigned short *old_units = work_units;
+        int *old_start = unit_start;
+        int old_num = num_units;
+        work_units = NULL;
+        unit_start = NULL;
+        num_units = units_len = units_capacity = starts_capacity = 0;
+        changed = 0;
+        
+        for (int i = 0; i < old_num; i++) {
+            unsigned short *u = old_units + old_start[i];
+            unsigned int depth = UNIT_DEPTH(u), n = UNIT_NEXT(u), e = UNIT_END(u);
+            refaz_prefixo(g, s, u);
+            
+            uint64_t *mask = s->scratch;
+            unsigned int live = 0;
+            if (candidatos_da_celula(g, s, escolhe_celula(g, s, depth), mask))
+                for (unsigned int r = proximo_bit(mask, n, e); r < e; r = proximo_bit(mask, r + 1, e))
+                    live++;
+            
+            if (live >= 2) {
+                unsigned int mid = proximo_bit(mask, n, e);
+                for (unsigned int k = 0; k < live / 2; k++)
+                    mid = proximo_bit(mask, mid + 1, e);
+                copia_unidade(u, n, mid);
+                copia_unidade(u, mid, e);
+                changed = 1;
+            } else if (live == 1 && depth + 1 < g->ncells) {
+                unsigned short *v = nova_unidade(depth + 1, 0, 4 * g->tile_count);
+                memcpy(UNIT_PREFIX(v), UNIT_PREFIX(u), depth * sizeof(unsigned short));
+                UNIT_PREFIX(v)[depth] = proximo_bit(mask, n, e);
+                changed = 1;
+            } else if (live == 1) {
+                copia_unidade(u, n, e);
+            } else {
+                changed = 1;
+            }
+            limpa_busca(g, s);
+        }
+        free(old_units);
+        free(old_start);
+    }
+}
+
+/*
+ * Retoma a busca do checkpoint em path (processo 0): confere que ele é
+ * desta instância e destas opções, refaz a fila com as unidades pendentes
+ * (validando cada prefixo) e a subdivide para nprocs processos
+ */
+void carrega_checkpoint(game *g, search *s, const char *path, int nprocs) {
+    FILE *f = fopen(path, "rb");
+    checkpoint_header h;
+    unsigned short *buf = NULL;
+    const char *erro = NULL;
+    
+    if (!f || fread(&h, sizeof(h), 1, f) != 1 ||
+        memcmp(h.magic, CHECKPOINT_MAGIC, 4) != 0 || h.version != CHECKPOINT_VERSION)
+        erro = "arquivo ilegível ou que não é um checkpoint";
+    else if (h.size != g->size || h.ncolors != g->ncolors || h.tiles_hash != hash_pecas(g))
+        erro = "checkpoint de outra instância";
+    else if (h.cell_order != (uint32_t)cell_order)
+        erro = "checkpoint gravado com outra ordem de visita (-o)";
+    else if (h.canon_tile != g->canon_tile)
+        erro = "checkpoint gravado com outra quina canônica";
+    else {
+        buf = malloc((h.len + 1) * sizeof(unsigned short));
+        if (fread(buf, sizeof(unsigned short), h.len, f) != h.len)
+            erro = "checkpoint truncado";
+    }
+    if (f) fclose(f);
+    
+    num_units = units_len = 0;
+    for (uint64_t pos = 0; !erro && pos < h.len; pos += UNIT_LEN(buf + pos)) {
+        unsigned short *u = buf + pos;
+        if (pos + 3 > h.len || pos + UNIT_LEN(u) > h.len || UNIT_DEPTH(u) >= g->ncells ||
+            UNIT_NEXT(u) > UNIT_END(u) || UNIT_END(u) > 4 * g->tile_count ||
+            !refaz_prefixo(g, s, u))
+            erro = "unidade inválida no checkpoint";
+        else
+            copia_unidade(u, UNIT_NEXT(u), UNIT_END(u));
+        limpa_busca(g, s);
+    }
+    free(buf);
+    if (erro) {
+        fprintf(stderr, "%s: %s\n", path, erro);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    
+    int pending = num_units;
+    resumed_solutions = h.solutions;
+    divide_unidades(g, s, UNITS_PER_RANK * nprocs);
+    work_depth = 0;
+    for (int i = 0; i < num_units; i++)
+        if (UNIT_DEPTH(UNIT(i)) > work_depth) work_depth = UNIT_DEPTH(UNIT(i));
+    char text[COUNT_TEXT];
+    printf("Retomando de %s: %d unidades pendentes (%d após a subdivisão), "
+           "%s soluções já encontradas\n\n", path, pending, num_units,
+           formata_contagem(text, pondera_solucoes(g, resumed_solutions)));
+}
+
+/*
+ * Executa uma unidade de trabalho: fixa o prefixo no tabuleiro da thread 0
+ * e busca a partir do nível seguinte, restrito ao intervalo da unidade e
+ * sem retroceder sobre o prefixo; as demais threads entram na busca
+ * roubando partes dela. Com -d, a solução é a primeira da unidade na ordem
+ * da busca serial, qualquer que seja a thread que a encontrou
+ * Retorna 1 se encontrou solução (o tabuleiro de workers[winner] fica
+ * preenchido)
+ */
+int executa_unidade(game *g, unsigned short *unit) {
+    search *s = &workers[0];
+    unsigned int depth = UNIT_DEPTH(unit);
+    // Com -o mrv a célula de cada nível depende das peças anteriores, e é
+    // escolhida de novo exatamente como na geração da unidade
+    for (unsigned int d = 0; d < depth; d++)
+        coloca_peca(g, s, escolhe_celula(g, s, d), UNIT_PREFIX(unit)[d]);
+    
+    start_search(g, s, depth);
+    frame *f = &s->stack[depth];
+    unsigned long long w = atomic_load_explicit(&f->range, memory_order_relaxed);
+    unsigned int n = R_NEXT(w) > UNIT_NEXT(unit) ? R_NEXT(w) : UNIT_NEXT(unit);
+    unsigned int e = R_END(w) < UNIT_END(unit) ? R_END(w) : UNIT_END(unit);
+    atomic_store_explicit(&f->range, RANGE(n < e ? n : e, e, R_GEN(w)), memory_order_relaxed);
+    winner = ordered_thread = -1;
+    if (deterministic) ordered_path = realloc(ordered_path, g->ncells * sizeof(unsigned short));
+    idle_threads = nthreads - 1;
+    encerradas = 0;
+    em_unidade = 1;
+    
+#ifdef _OPENMP
+    #pragma omp parallel num_threads(nthreads)
+    {
+        int id = omp_get_thread_num();
+        busca_paralela(g, id);
+        if (id != 0) atomic_fetch_add(&encerradas, 1);
+    }
+#else
+    busca_paralela(g, 0);
+#endif
+    em_unidade = 0;
+    
+    // Desfaz o estado das threads para a próxima unidade
+    for (int t = 0; t < nthreads; t++)
+        if (t != winner) limpa_busca(g, &workers[t]);
+    
+    // Com -d, a primeira solução da unidade é refeita no tabuleiro da thread 0
+    if (ordered_thread >= 0) {
+        for (unsigned int d = 0; d < g->ncells; d++)
+            coloca_peca(g, s, escolhe_celula(g, s, d), ordered_path[d]);
+        s->depth = g->ncells;
+        winner = 0;
+    }
+    return winner >= 0;
+}
+
+/*
+ * Laço do processo 0: consome unidades da própria fila (atendendo pedidos
+ * durante a busca) e, ao encontrar solução ou esgotar a fila, anuncia a
+ * parada. Depois continua atendendo pedidos e avisos até que a barreira
+ * não bloqueante indique que nenhum processo tem mais mensagens a enviar.
+ * Retorna 1 se encontrou solução localmente
+ */
+int mestre(game *g, int nworkers) {
+    int found = 0;
+    
+    unit_of = malloc((nworkers + 1) * sizeof(int));
+    worker_solutions = calloc(nworkers + 1, sizeof(unsigned long long));
+    worker_tasks = calloc(nworkers + 1, sizeof(unsigned short *));
+    worker_tasks_len = malloc((nworkers + 1) * sizeof(int));
+    for (int w = 0; w <= nworkers; w++)
+        unit_of[w] = worker_tasks_len[w] = -1;
+    last_checkpoint = get_time();
+    progress_start = last_progress = get_time();
+    if (progress_path) {
+        progress_ranks = calloc(nworkers + 1, sizeof(progresso));
+        for (int w = 0; w <= nworkers; w++)
+            progress_ranks[w].time = progress_start;
+    }
+    
+    // verifica_parada() pode entregar unidades, então a fila é testada depois
+    // Com -d, a fila para na primeira unidade com solução
+    while (!verifica_parada(g) && next_unit < num_units && ordered_unit < 0) {
+        int u = unit_of[0] = next_unit++;
+        if (executa_unidade(g, UNIT(u))) {
+            if (deterministic)
+                registra_ordem(0, u);
+            else
+                avisa_parada();
+            found = 1;
+        }
+        unit_of[0] = -1;
+    }
+    
+    MPI_Request barrier = MPI_REQUEST_NULL;
+    int done = 0;
+    while (!done) {
+        int flag;
+        MPI_Status status;
+        MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, work_comm, &flag, &status);
+        if (flag) atende_mensagem(&status);
+        if (deterministic) confere_ordem();
+        
+        // Todos os trabalhadores esgotaram a fila sem solução, ou o tempo
+        // limite acabou enquanto alguns ainda buscam
+        if (!stop_announced && idle_workers == nworkers)
+            anuncia_parada(-1);
+        if (!stop_announced && tempo_esgotado()) encerra_por_tempo(g);
+        if (progress_path && get_time() - last_progress >= progress_interval)
+            publica_progresso(g, get_time(), 0);
+        
+        if (stop_announced) {
+            if (barrier == MPI_REQUEST_NULL)
+                MPI_Ibarrier(work_comm, &barrier);
+            MPI_Test(&barrier, &done, MPI_STATUS_IGNORE);
+        }
+    }
+    MPI_Wait(&stop_req, MPI_STATUS_IGNORE);
+    if (progress_path) {
+        publica_progresso(g, get_time(), 1);
+        free(progress_ranks);
+    }
+    
+    for (int w = 0; w <= nworkers; w++)
+        free(worker_tasks[w]);
+    free(worker_tasks);
+    free(worker_tasks_len);
+    free(worker_solutions);
+    free(unit_of);
+    return found;
+}
+
+/*
+ * Laço dos demais processos: pede uma unidade ao processo 0, executa e
+ * repete até a fila acabar ou a parada ser anunciada. Termina entrando na
+ * barreira não bloqueante (depois que o próprio aviso foi recebido) e
+ * esperando o anúncio do processo 0.
+ * Retorna 1 se encontrou solução localmente
+ */
+int trabalhador(game *g) {
+    unsigned short *unit = malloc((g->ncells + 3) * sizeof(unsigned short));
+    int found = 0;
+    
+    MPI_Ibcast(&stop_rank, 1, MPI_INT, 0, work_comm, &stop_req);
+    last_checkpoint = last_progress = get_time();
+    
+    while (!found && !verifica_parada(g)) {
+        unsigned long long solutions = soma_solucoes();
+        MPI_Send(&solutions, 1, MPI_UNSIGNED_LONG_LONG, 0, TAG_PEDIDO, work_comm);
+        
+        // O processo 0 sempre responde, mesmo depois de anunciar a parada
+        MPI_Status status;
+        MPI_Recv(unit, g->ncells + 3, MPI_UNSIGNED_SHORT, 0, MPI_ANY_TAG,
+                 work_comm, &status);
+        if (status.MPI_TAG == TAG_SEM_TRABALHO) break;
+        
+        if (executa_unidade(g, unit)) {
+            avisa_parada();
+            found = 1;
+        }
+    }
+    
+    MPI_Request barrier;
+    MPI_Wait(&aviso_req, MPI_STATUS_IGNORE);
+    if (progress_path) {
+        // O relato final chega ao processo 0 antes da barreira
+        MPI_Wait(&progresso_req, MPI_STATUS_IGNORE);
+        publica_progresso(g, get_time(), 1);
+        MPI_Wait(&progresso_req, MPI_STATUS_IGNORE);
+    }
+    MPI_Ibarrier(work_comm, &barrier);
+    MPI_Wait(&barrier, MPI_STATUS_IGNORE);
+    MPI_Wait(&stop_req, MPI_STATUS_IGNORE);
+    solution_owner = stop_rank;
+    
+    free(unit);
+    return found;
+}
+
+/*
+ * Reduz o melhor tabuleiro parcial entre os processos ativos e o imprime
+ * no processo 0 (-p, sem solução)
+ * MPI_MAXLOC escolhe o processo com mais peças (o de menor rank nos
+ * empates), que envia seu tabuleiro ao processo 0.
+ */
+void reduz_parcial(game *g) {
+    unsigned short *refs = malloc(g->tile_count * sizeof(unsigned short));
+    struct { int depth; int rank; } local, best;
+    local.depth = melhor_parcial(g, refs);
+    local.rank = rank;
+    MPI_Allreduce(&local, &best, 1, MPI_2INT, MPI_MAXLOC, work_comm);
+    if (best.rank != 0) {
+        if (rank == best.rank)
+            MPI_Send(refs, g->tile_count, MPI_UNSIGNED_SHORT, 0, TAG_PARCIAL, work_comm);
+        else if (rank == 0)
+            MPI_Recv(refs, g->tile_count, MPI_UNSIGNED_SHORT, best.rank, TAG_PARCIAL,
+                     work_comm, MPI_STATUS_IGNORE);
+    }
+    if (rank == 0) imprime_parcial(g->size, refs, best.rank);
+    free(refs);
+}
+
+/*
+ * Distribui o problema do processo 0 para os processos ativos em um único
+ * broadcast: dimensões, profundidade das unidades, quina canônica e peças
+ * vão empacotados no mesmo buffer. Os demais processos reconstroem
+ * localmente as peças rotacionadas, os bitsets de cores e a ordem de
+ * visita.
+ * Retorna o jogo (no processo 0, o próprio g)
+ */
+game *distribui_jogo(game *g, unsigned int tile_count) {
+    int header_size, tiles_size, pos = 0;
+    MPI_Pack_size(4, MPI_INT, work_comm, &header_size);
+    MPI_Pack_size(tile_count * sizeof(tile), MPI_BYTE, work_comm, &tiles_size);
+    int buf_size = header_size + tiles_size;
+    char *buf = malloc(buf_size);
+    
+    if (rank == 0) {
+        int header[4] = { g->size, g->ncolors, work_depth, g->canon_tile };
+        MPI_Pack(header, 4, MPI_INT, buf, buf_size, &pos, work_comm);
+        MPI_Pack(g->tiles, tile_count * sizeof(tile), MPI_BYTE, buf, buf_size, &pos, work_comm);
+    }
+    MPI_Bcast(buf, buf_size, MPI_PACKED, 0, work_comm);
+    
+    if (rank != 0) {
+        int header[4];
+        MPI_Unpack(buf, buf_size, &pos, header, 4, MPI_INT, work_comm);
+        g = calloc(1, sizeof(game));
+        g->size = header[0];
+        g->tile_count = tile_count;
+        g->ncolors = header[1];
+        g->stride = header[0] + 2;
+        work_depth = header[2];
+        g->tiles = malloc(tile_count * sizeof(tile));
+        MPI_Unpack(buf, buf_size, &pos, g->tiles, tile_count * sizeof(tile), MPI_BYTE, work_comm);
+        
+        build_pieces(g);
+        build_masks(g);
+        fixa_quina_canonica(g, header[3]);
+        build_order(g);
+        alloc_workers(g);
+    }
+    
+    free(buf);
+    return g;
+}
+
+/*
+ * Soma os contadores das threads e depois os dos processos (MPI_Reduce no
+ * processo 0) e imprime o resumo da busca, com nós por segundo; com -s,
+ * também o histograma de nós por profundidade
+ */
+void imprime_estatisticas(game *g, double elapsed) {
+    unsigned long long local[STATS_COUNTERS] = { 0 }, total[STATS_COUNTERS];
+    unsigned long long local_max = 0, max_depth;
+    unsigned long long *local_hist = calloc(g->ncells + 1, sizeof(unsigned long long));
+    unsigned long long *hist = calloc(g->ncells + 1, sizeof(unsigned long long));
+    for (int t = 0; t < nthreads; t++) {
+        unsigned long long *c = &workers[t].stats.nodes;
+        for (int i = 0; i < STATS_COUNTERS; i++)
+            local[i] += c[i];
+        if (workers[t].stats.max_depth > local_max) local_max = workers[t].stats.max_depth;
+        for (unsigned int d = 0; d <= g->ncells; d++)
+            local_hist[d] += workers[t].depth_nodes[d];
+    }
+    MPI_Reduce(local, total, STATS_COUNTERS, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, work_comm);
+    MPI_Reduce(&local_max, &max_depth, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX, 0, work_comm);
+    MPI_Reduce(local_hist, hist, g->ncells + 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, work_comm);
+    
+    if (rank == 0) {
+        printf("\n=== Estatísticas da busca ===\n");
+        printf("Nós visitados: %llu (%.0f nós/s)\n", total[0],
+               elapsed > 0 ? total[0] / elapsed : 0.0);
+        printf("Candidatos testados: %llu\n", total[1]);
+        printf("Rejeitados pela verificação adiante: %llu\n", total[2]);
+        printf("Células sem candidatos: %llu\n", total[3]);
+        printf("Roubos entre threads: %llu\n", total[4]);
+        if (cache_mb) printf("Subárvores descartadas pela tabela de becos: %llu\n", total[5]);
+        printf("Profundidade máxima: %llu de %u\n", max_depth, g->ncells);
+        if (stats_interval > 0) {
+            printf("Nós por profundidade:\n");
+            for (unsigned int d = 0; d < g->ncells; d++)
+                if (hist[d]) printf("  profundidade %u: %llu\n", d + 1, hist[d]);
+        }
+    }
+    free(local_hist);
+    free(hist);
+}
+
+/*
+ * Imprime a solução encontrada no formato esperado
+ */
+void print_solution(game *game, search *s) {
+    printf("\n=== SOLUÇÃO ENCONTRADA ===\n");
+    for(unsigned int j = 0; j < game->size; j++) {
+        for(unsigned int i = 0; i < game->size; i++) {
+            unsigned short ref = s->board[CELL(game, i, j)];
+            printf("%u %u\n", PIECE_ID(ref), PIECE_ROT(ref));
+        }
+    }
+    printf("=========================\n");
+}
+
+/*
+ * Resolve a instância g do lote com as threads do processo e libera g
+ * Fixa a quina canônica e busca a árvore inteira como uma única unidade,
+ * dividida entre as threads por roubo de trabalho. Preenche nodes,
+ * solutions, seconds e, se encontrou solução (fora de -c), refs com as
+ * peças linha por linha; sem solução e com -p, refs recebe o melhor
+ * tabuleiro parcial. O tempo limite (-l) conta a partir daqui, e
+ * time_expired diz se ele interrompeu a busca. motivo recebe o motivo de
+ * inviabilidade se a instância foi descartada sem busca, ou NULL.
+ * Retorna 1 se encontrou solução
+ */
+int resolve_instancia(game *g, unsigned short *refs, const char **motivo,
+                      unsigned long long *nodes, unsigned long long *solutions, double *seconds) {
+    double start = time_start = get_time();
+    int num_corners, found = 0;
+    time_expired = global_stop = 0;
+    corner_info *corners = separar_pecas_de_quina(g, &num_corners);
+    *motivo = num_corners > 0 ? inviabilidade(g) : NULL;
+    build_masks(g);
+    fixa_quina_canonica(g, escolhe_quina_canonica(g, corners, num_corners));
+    build_order(g);
+    if (nthreads > 1 && g->ncells > STEAL_CUTOFF)
+        g->steal_limit = g->ncells - STEAL_CUTOFF;
+    alloc_workers(g);
+    
+    if (num_corners > 0 && !*motivo) {
+        unsigned short unit[3] = { 0, 0, 4 * g->tile_count };
+        found = executa_unidade(g, unit);
+        if (found && !count_mode)
+            for (unsigned int y = 0; y < g->size; y++)
+                for (unsigned int x = 0; x < g->size; x++)
+                    refs[y * g->size + x] = workers[winner].board[CELL(g, x, y)];
+    }
+    if (!found && partial_mode) melhor_parcial(g, refs);
+    
+    *solutions = pondera_solucoes(g, soma_solucoes());
+    if (count_mode) found = (*solutions > 0);
+    *nodes = 0;
+    for (int t = 0; t < nthreads; t++) {
+        *nodes += workers[t].stats.nodes;
+        free_search(&workers[t]);
+    }
+    free(workers);
+    workers = NULL;
+    free(corners);
+    free_resources(g);
+    *seconds = get_time() - start;
+    return found;
+}
+
+/*
+ * Laço do processo 0 no modo lote: resolve instâncias da fila enquanto
+ * houver (atendendo os demais processos durante a busca) e depois espera
+ * o último resultado de cada um
+ */
+void mestre_lote() {
+    while (batch_next < batch_count) {
+        atende_lote();
+        if (batch_next == batch_count) break;
+        
+        int index = batch_next++;
+        game *g = batch_games[index];
+        batch_games[index] = NULL;
+        unsigned int board_size = g->size;
+        unsigned short *refs = malloc(g->tile_count * sizeof(unsigned short));
+        unsigned long long nodes, solutions;
+        double seconds;
+        const char *motivo;
+        int found = resolve_instancia(g, refs, &motivo, &nodes, &solutions, &seconds);
+        imprime_resultado(index, 0, found, time_expired, motivo, seconds, nodes, solutions,
+                          (found && !count_mode) || partial_mode ? refs : NULL, board_size);
+        free(refs);
+    }
+    
+    while (batch_done_workers < size - 1) {
+        MPI_Status status;
+        MPI_Probe(MPI_ANY_SOURCE, TAG_LOTE, job_comm, &status);
+        atende_resultado(status.MPI_SOURCE);
+    }
+}
+
+/*
+ * Laço dos demais processos no modo lote: envia o resultado anterior (o
+ * primeiro envio é só o pedido), recebe a próxima instância e a resolve,
+ * até o processo 0 responder TAG_SEM_TRABALHO
  */
-#define X_COLOR(t, s) (t->colors[(s + 4 - t->rotation) % 4])
-#define N_COLOR(t) (X_COLOR(t, 0))  // Norte
-#define E_COLOR(t) (X_COLOR(t, 1))  // Leste
-#define S_COLOR(t) (X_COLOR(t, 2))  // Sul
-#define W_COLOR(t) (X_COLOR(t, 3))  // Oeste
+void trabalhador_lote() {
+    int index = -1, found = 0, board_size = 0;
+    unsigned long long nodes = 0, solutions = 0;
+    double seconds = 0;
+    unsigned short *refs = NULL;
+    const char *motivo = NULL;
+    
+    for (;;) {
+        envia_resultado(index, found, time_expired, motivo, nodes, solutions, seconds, refs,
+                        (found && !count_mode) || partial_mode ? board_size : 0);
+        free(refs);
+        refs = NULL;
+        
+        MPI_Status status;
+        int bytes, pos = 0;
+        MPI_Probe(0, MPI_ANY_TAG, job_comm, &status);
+        if (status.MPI_TAG == TAG_SEM_TRABALHO) {
+            MPI_Recv(NULL, 0, MPI_BYTE, 0, TAG_SEM_TRABALHO, job_comm, MPI_STATUS_IGNORE);
+            break;
+        }
+        MPI_Get_count(&status, MPI_PACKED, &bytes);
+        char *buf = malloc(bytes);
+        MPI_Recv(buf, bytes, MPI_PACKED, 0, TAG_INSTANCIA, job_comm, MPI_STATUS_IGNORE);
+        
+        // Reconstrói a instância como em distribui_jogo
+        int header[3];
+        MPI_Unpack(buf, bytes, &pos, header, 3, MPI_INT, job_comm);
+        game *g = calloc(1, sizeof(game));
+        index = header[0];
+        g->size = header[1];
+        g->tile_count = g->size * g->size;
+        g->ncolors = header[2];
+        g->stride = g->size + 2;
+        g->tiles = malloc(g->tile_count * sizeof(tile));
+        MPI_Unpack(buf, bytes, &pos, g->tiles, g->tile_count * sizeof(tile), MPI_BYTE,
+                   job_comm);
+        free(buf);
+        build_pieces(g);
+        
+        board_size = g->size;
+        refs = malloc(g->tile_count * sizeof(unsigned short));
+        found = resolve_instancia(g, refs, &motivo, &nodes, &solutions, &seconds);
+    }
+}
 
 /*
- * Função auxiliar para medição de tempo
- * Retorna tempo atual em segundos com precisão de microssegundos
+ * Executa o modo lote: o processo 0 lê as instâncias dos nfiles arquivos
+ * (ou da entrada padrão) e coordena; os demais resolvem sob demanda
+ * Uma instância inválida interrompe a leitura do seu arquivo, já que não
+ * se sabe onde a seguinte começaria; as anteriores continuam no lote.
  */
-double get_time() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return tv.tv_sec + tv.tv_usec / 1000000.0;
+void executa_lote(int nfiles, char **files) {
+    if (rank != 0) {
+        trabalhador_lote();
+        return;
+    }
+    
+    int capacity = 0;
+    for (int f = 0; f < (nfiles > 0 ? nfiles : 1); f++) {
+        const char *name = nfiles > 0 ? files[f] : "entrada padrão";
+        FILE *input = nfiles > 0 ? fopen(name, "rb") : stdin;
+        if (!input) {
+            fprintf(stderr, "%s: não foi possível abrir o arquivo\n", name);
+            continue;
+        }
+        entrada *in = le_entrada(input);
+        if (input != stdin) fclose(input);
+        while (pula_espacos(in)) {
+            game *g = initialize(in);
+            if (!g) {
+                fprintf(stderr, "%s: instância inválida; o restante do arquivo foi ignorado\n", name);
+                break;
+            }
+            if (batch_count == capacity) {
+                capacity = 2 * capacity + 16;
+                batch_games = realloc(batch_games, capacity * sizeof(game *));
+                batch_names = realloc(batch_names, capacity * sizeof(const char *));
+            }
+            batch_games[batch_count] = g;
+            batch_names[batch_count++] = name;
+        }
+        libera_entrada(in);
+    }
+    
+    printf("Eternity II Paralelo - lote de %d instâncias, %d processos x %d threads, ordem %s\n",
+           batch_count, size, nthreads, order_names[cell_order]);
+    double start = get_time();
+    mestre_lote();
+    printf("\nLote: %d instâncias, %d com solução, %.6f segundos\n",
+           batch_count, batch_solved, get_time() - start);
+    free(batch_games);
+    free(batch_names);
 }
 
 /*
- * Estrutura principal do jogo
- * size: dimensão do tabuleiro (size x size)
- * tile_count: número total de peças (= size²)
- * board: matriz de ponteiros para peças colocadas no tabuleiro
- * tiles: array com todas as peças disponíveis
+ * Recozimento simulado (-a)
+ * Alternativa aproximada ao backtracking: cada thread de cada processo é
+ * uma cadeia independente que parte de um tabuleiro completo aleatório e
+ * troca ou gira peças, minimizando as arestas internas não casadas. As
+ * peças ficam sempre na sua classe (quinas nas quinas, bordas na borda,
+ * internas no interior) e as de borda sempre com os lados 0 para fora, de
+ * modo que o anel de BORDER nunca fica descasado. A cada época de SA_EPOCH
+ * passos, os processos trocam o melhor tabuleiro global, que substitui a
+ * pior cadeia de cada processo.
  */
-typedef struct {
-    unsigned int size;
-    unsigned int tile_count;
-    tile ***board;
-    tile *tiles;
-} game;
 
 /*
- * Estrutura para informações de peças de quina
- * tile_id: ID da peça que pode ser quina
- * rotation: rotação necessária para colocar na quina
- * corner_type: tipo de quina (0=sup_esq, 1=sup_dir, 2=inf_esq, 3=inf_dir)
+ * Cadeia do recozimento
+ * board: tabuleiro completo, com o anel de BORDER, como em search
+ * cost: arestas internas não casadas de board
+ * best/best_cost: melhor tabuleiro da cadeia e seu custo
+ * heat: probabilidade de aceitar um passo que descasa uma aresta a mais,
+ *   exp(-1 / temperatura); um passo que descasa d arestas é aceito com
+ *   probabilidade heat^d
+ * rng: estado do gerador xorshift64* da cadeia
+ * steps/accepted: passos dados e aceitos
  */
 typedef struct {
-    int tile_id;           
-    unsigned char rotation;
-    int corner_type;       
-} corner_info;
+    unsigned short *board;
+    unsigned short *best;
+    unsigned int cost;
+    unsigned int best_cost;
+    double heat;
+    uint64_t rng;
+    unsigned long long steps;
+    unsigned long long accepted;
+} cadeia;
 
-/* Variáveis globais MPI e controle de execução */
-int rank, size;                    // Rank e tamanho do comunicador MPI
-double time_init, time_end;        // Variáveis para medição de tempo
-int global_stop = 0;               // Flag para parada global
-int global_solution_found = 0;     // Flag indicando se solução foi encontrada
-int solution_owner = -1;           // Rank do processo que encontrou a solução
+/* Células de cada classe: 0 quinas, 1 bordas, 2 internas */
+unsigned int *sa_cells[3];
+unsigned int sa_count[3];
 
 /*
- * Inicializa o jogo a partir de entrada padrão
- * Lê dimensão do tabuleiro, número de cores e todas as peças
- * Retorna ponteiro para estrutura game alocada dinamicamente
+ * Retorna a classe de uma peça pelos lados 0: quina (dois adjacentes, ou os
+ * quatro num tabuleiro 1x1), borda (um) ou interna (nenhum)
+ * Retorna -1 se a peça não cabe em classe nenhuma
  */
-game *initialize(FILE *input) {
-    unsigned int bsize;
-    unsigned int ncolors;
-    
-    // Lê dimensões e valida entrada
-    int r = fscanf(input, "%u", &bsize);
-    assert(r == 1);
-    r = fscanf(input, "%u", &ncolors);
-    assert(r == 1);
-    assert(ncolors < 256);
-
-    // Aloca estrutura principal do jogo
-    game *g = malloc(sizeof(game));
-    g->size = bsize;
-    g->tile_count = bsize * bsize;
-    
-    // Aloca tabuleiro como matriz de ponteiros
-    g->board = malloc(sizeof(tile**) * bsize);
-    for(int i = 0; i < bsize; i++)
-        g->board[i] = calloc(bsize, sizeof(tile*));
-
-    // Aloca e inicializa array de peças
-    g->tiles = malloc(g->tile_count * sizeof(tile));
-    for (unsigned int i = 0; i < g->tile_count; i++) {
-        g->tiles[i].rotation = 0;
-        g->tiles[i].id = i;
-        g->tiles[i].used = 0;
-        
-        // Lê cores das 4 bordas de cada peça
-        for (int c = 0; c < 4; c++) {
-            r = fscanf(input, "%u", &g->tiles[i].colors[c]);
-            assert(r == 1);
-        }
-    }
-    return g;
+int classe_da_peca(game *g, unsigned int id) {
+    unsigned char *c = g->tiles[id].colors;
+    int zeros = (c[0] == 0) + (c[1] == 0) + (c[2] == 0) + (c[3] == 0);
+    if (g->size == 1) return zeros == 4 ? 0 : -1;
+    if (zeros == 2) return (c[0] == 0) == (c[2] == 0) ? -1 : 0;
+    return zeros == 1 ? 1 : zeros == 0 ? 2 : -1;
 }
 
 /*
- * Libera toda a memória alocada para o jogo
+ * Retorna a referência da peça id na rotação que a encaixa no anel ao
+ * redor de cell: lado 0 exatamente onde o vizinho é BORDER (a rotação 0 se
+ * nenhuma encaixa)
  */
-void free_resources(game *game) {
-    for(int i = 0; i < game->size; i++)
-        free(game->board[i]);
-    free(game->board);
-    free(game->tiles);
-    free(game);
+unsigned short orienta(game *g, const unsigned short *board, unsigned int id, unsigned int cell) {
+    for (int rot = 0; rot < 4; rot++) {
+        piece p = g->pieces[id * 4 + rot];
+        int fits = 1;
+        for (int side = 0; side < 4 && fits; side++)
+            fits = (X_COLOR(p, side) == 0) == (board[cell + g->offset[side]] == BORDER(g));
+        if (fits) return id * 4 + rot;
+    }
+    return id * 4;
 }
 
 /*
- * Verifica se uma peça pode ser colocada em uma posição específica
- * Valida bordas do tabuleiro (devem ter cor 0) e compatibilidade com vizinhos
- * Retorna 1 se movimento é válido, 0 caso contrário
+ * Conta as arestas não casadas que tocam as células a e b (ou só a, se
+ * a == b), cada uma uma única vez
  */
-int valid_move(game *game, unsigned int x, unsigned int y, tile *tile) {
-    // Verifica bordas do tabuleiro (devem ter cor 0)
-    if (x == 0 && W_COLOR(tile) != 0) return 0;                    // Borda oeste
-    if (y == 0 && N_COLOR(tile) != 0) return 0;                    // Borda norte
-    if (x == game->size - 1 && E_COLOR(tile) != 0) return 0;       // Borda leste
-    if (y == game->size - 1 && S_COLOR(tile) != 0) return 0;       // Borda sul
-
-    // Verifica compatibilidade com vizinhos já colocados
-    if (x > 0 && game->board[x - 1][y] != NULL &&
-        E_COLOR(game->board[x - 1][y]) != W_COLOR(tile))
-        return 0;
-    if (x < game->size - 1 && game->board[x + 1][y] != NULL &&
-        W_COLOR(game->board[x + 1][y]) != E_COLOR(tile))
-        return 0;
-    if (y > 0 && game->board[x][y - 1] != NULL &&
-        S_COLOR(game->board[x][y - 1]) != N_COLOR(tile))
-        return 0;
-    if (y < game->size - 1 && game->board[x][y + 1] != NULL &&
-        N_COLOR(game->board[x][y + 1]) != S_COLOR(tile))
-        return 0;
-
-    return 1;
+unsigned int custo_celulas(game *g, const unsigned short *board, unsigned int a, unsigned int b) {
+    unsigned int cost = 0, cells[2] = { a, b };
+    for (int k = 0; k < (a == b ? 1 : 2); k++) {
+        piece p = g->pieces[board[cells[k]]];
+        for (int side = 0; side < 4; side++) {
+            unsigned int nb = cells[k] + g->offset[side];
+            if (k == 1 && nb == a) continue; // Aresta entre a e b, já contada
+            cost += X_COLOR(p, side) != X_COLOR(g->pieces[board[nb]], (side + 2) % 4);
+        }
+    }
+    return cost;
 }
 
 /*
- * Verifica se uma peça pode ser colocada em alguma quina do tabuleiro
- * Testa todas as 4 rotações para encontrar configuração válida
- * Retorna 1 se é peça de quina, 0 caso contrário
- * Parâmetros de saída: rotacao_valida e tipo_canto
+ * Gira a peça interna da célula cell para a rotação com menos arestas não
+ * casadas com os vizinhos atuais
  */
-int eh_peca_de_quina(tile *t, unsigned char *rotacao_valida, int *tipo_canto) {
+void gira_melhor(game *g, unsigned short *board, unsigned int cell) {
+    unsigned short id = PIECE_ID(board[cell]), best = board[cell];
+    unsigned int best_cost = ~0u;
     for (int rot = 0; rot < 4; rot++) {
-        t->rotation = rot;
-        
-        // Quina superior esquerda (Norte=0, Oeste=0)
-        if (N_COLOR(t) == 0 && W_COLOR(t) == 0) {
-            *rotacao_valida = rot;
-            *tipo_canto = 0;
-            return 1;
+        board[cell] = id * 4 + rot;
+        unsigned int cost = custo_celulas(g, board, cell, cell);
+        if (cost < best_cost) {
+            best_cost = cost;
+            best = board[cell];
         }
-        // Quina superior direita (Norte=0, Leste=0)
-        if (N_COLOR(t) == 0 && E_COLOR(t) == 0) {
-            *rotacao_valida = rot;
-            *tipo_canto = 1;
-            return 1;
+    }
+    board[cell] = best;
+}
+
+/*
+ * Retorna o total de arestas não casadas de board
+ */
+unsigned int custo_total(game *g, const unsigned short *board) {
+    unsigned int cost = 0;
+    for (unsigned int y = 0; y < g->size; y++)
+        for (unsigned int x = 0; x < g->size; x++) {
+            piece p = g->pieces[board[CELL(g, x, y)]];
+            if (x + 1 < g->size)
+                cost += E_COLOR(p) != W_COLOR(g->pieces[board[CELL(g, x + 1, y)]]);
+            if (y + 1 < g->size)
+                cost += S_COLOR(p) != N_COLOR(g->pieces[board[CELL(g, x, y + 1)]]);
         }
-        // Quina inferior esquerda (Sul=0, Oeste=0)
-        if (S_COLOR(t) == 0 && W_COLOR(t) == 0) {
-            *rotacao_valida = rot;
-            *tipo_canto = 2;
-            return 1;
+    return cost;
+}
+
+/*
+ * Inicia a cadeia c com as peças de cada classe embaralhadas nas células
+ * da classe, as de borda orientadas e as internas em rotações aleatórias
+ */
+void inicia_cadeia(game *g, cadeia *c, uint64_t seed) {
+    size_t cells = g->stride * g->stride;
+    c->board = malloc(cells * sizeof(unsigned short));
+    c->best = malloc(cells * sizeof(unsigned short));
+    c->rng = seed ? seed : 1;
+    for (size_t i = 0; i < cells; i++)
+        c->board[i] = BORDER(g);
+    
+    for (unsigned int y = 0; y < g->size; y++)
+        for (unsigned int x = 0; x < g->size; x++)
+            c->board[CELL(g, x, y)] = EMPTY;
+    
+    unsigned int *ids = malloc(g->tile_count * sizeof(unsigned int));
+    for (int k = 0; k < 3; k++) {
+        unsigned int n = 0;
+        for (unsigned int id = 0; id < g->tile_count; id++)
+            if (classe_da_peca(g, id) == k) ids[n++] = id;
+        for (unsigned int i = n; i > 1; i--) {
+            unsigned int j = sorteia(&c->rng, i), t = ids[i - 1];
+            ids[i - 1] = ids[j];
+            ids[j] = t;
         }
-        // Quina inferior direita (Sul=0, Leste=0)
-        if (S_COLOR(t) == 0 && E_COLOR(t) == 0) {
-            *rotacao_valida = rot;
-            *tipo_canto = 3;
-            return 1;
+        for (unsigned int i = 0; i < n; i++) {
+            unsigned int cell = sa_cells[k][i];
+            c->board[cell] = k < 2 ? orienta(g, c->board, ids[i], cell) : ids[i] * 4 + sorteia(&c->rng, 4);
         }
     }
-    return 0;
+    free(ids);
+    
+    c->cost = c->best_cost = custo_total(g, c->board);
+    memcpy(c->best, c->board, cells * sizeof(unsigned short));
+    c->heat = SA_HEAT;
+    c->steps = c->accepted = 0;
 }
 
 /*
- * Identifica todas as peças que podem ser colocadas nas quinas
- * Retorna array dinâmico com informações das peças de quina
- * Parâmetro de saída: num_corner_pieces (número de peças encontradas)
+ * Dá até SA_EPOCH passos na cadeia c (para antes se zerar o custo)
+ * Cada passo gira uma peça interna ou troca duas peças da mesma classe
+ * (reorientando as de borda) e é aceito se não piora o custo, ou com
+ * probabilidade heat^delta; o custo muda só nas arestas das duas células,
+ * recontadas antes e depois (delta não passa das 8 arestas das duas).
  */
-corner_info* separar_pecas_de_quina(game *g, int *num_corner_pieces) {
-    corner_info *corners = malloc(g->tile_count * sizeof(corner_info));
-    *num_corner_pieces = 0;
+void epoca(game *g, cadeia *c) {
+    double accept[9] = { 1 };
+    for (int d = 1; d < 9; d++)
+        accept[d] = accept[d - 1] * c->heat;
     
-    if (rank == 0) {
-        printf("=== Identificando peças de quina ===\n");
-    }
-    
-    // Testa cada peça para ver se pode ser quina
-    for (int i = 0; i < g->tile_count; i++) {
-        tile *current_tile = &g->tiles[i];
-        unsigned char rotacao_original = current_tile->rotation;
-        unsigned char rotacao_valida;
-        int tipo_canto;
+    for (unsigned int i = 0; i < SA_EPOCH && c->best_cost > 0; i++) {
+        unsigned int r = sorteia(&c->rng, g->tile_count);
+        int k = r < sa_count[0] ? 0 : r < sa_count[0] + sa_count[1] ? 1 : 2;
+        unsigned int a = sa_cells[k][sorteia(&c->rng, sa_count[k])], b = a;
+        unsigned short old_a = c->board[a], old_b;
+        int rotate = (k == 2 && (sa_count[2] == 1 || sorteia(&c->rng, 2)));
+        if (!rotate) {
+            if (sa_count[k] < 2) continue;
+            while (b == a) b = sa_cells[k][sorteia(&c->rng, sa_count[k])];
+        }
+        old_b = c->board[b];
         
-        if (eh_peca_de_quina(current_tile, &rotacao_valida, &tipo_canto)) {
-            corners[*num_corner_pieces].tile_id = current_tile->id;
-            corners[*num_corner_pieces].rotation = rotacao_valida;
-            corners[*num_corner_pieces].corner_type = tipo_canto;
-            
-            if (rank == 0) {
-                printf("Peça ID %u pode ser quina tipo %d com rotação %u\n", 
-                       current_tile->id, tipo_canto, rotacao_valida);
-            }
-            
-            (*num_corner_pieces)++;
+        int before = custo_celulas(g, c->board, a, b);
+        if (rotate) {
+            c->board[a] = (old_a & ~3) | ((old_a + 1 + sorteia(&c->rng, 3)) & 3);
+        } else if (k == 2) {
+            c->board[a] = old_b;
+            c->board[b] = old_a;
+            gira_melhor(g, c->board, a);
+            gira_melhor(g, c->board, b);
+        } else {
+            c->board[a] = orienta(g, c->board, PIECE_ID(old_b), a);
+            c->board[b] = orienta(g, c->board, PIECE_ID(old_a), b);
         }
+        int delta = (int)custo_celulas(g, c->board, a, b) - before;
+        c->steps++;
         
-        // Restaura rotação original
-        current_tile->rotation = rotacao_original;
-    }
-    
-    if (rank == 0) {
-        printf("Total de peças de quina: %d\n\n", *num_corner_pieces);
+        if (delta <= 0 || sorteia(&c->rng, 1 << 30) * 0x1p-30 < accept[delta]) {
+            c->accepted++;
+            c->cost += delta;
+            if (c->cost < c->best_cost) {
+                c->best_cost = c->cost;
+                memcpy(c->best, c->board, g->stride * g->stride * sizeof(unsigned short));
+            }
+        } else {
+            c->board[a] = old_a;
+            c->board[b] = old_b;
+        }
     }
     
-    // Redimensiona array para o tamanho exato
-    if (*num_corner_pieces > 0) {
-        corners = realloc(corners, (*num_corner_pieces) * sizeof(corner_info));
-    } else {
-        free(corners);
-        corners = NULL;
+    // Resfria (1 / temperatura cresce em passos iguais); fria demais,
+    // reaquece a partir do melhor da cadeia
+    c->heat *= SA_COOLING;
+    if (c->heat < SA_HEAT_MIN) {
+        c->heat = SA_HEAT;
+        memcpy(c->board, c->best, g->stride * g->stride * sizeof(unsigned short));
+        c->cost = c->best_cost;
     }
-    
-    return corners;
 }
 
 /*
- * Algoritmo principal de backtracking para resolver o puzzle
- * Utiliza comunicação MPI assíncrona para parada antecipada
- * Retorna 1 se encontrou solução, 0 caso contrário
+ * Executa o recozimento simulado com nthreads cadeias por processo até
+ * alguma zerar o custo ou o tempo limite (-l) se esgotar
+ * A cada época, MPI_MINLOC escolhe o processo com a melhor cadeia, cujo
+ * tabuleiro é difundido e copiado para a pior cadeia de cada processo; a
+ * decisão de parar é do processo 0, como na busca exata.
+ * Retorna 1 se encontrou solução
  */
-int play(game *game, unsigned int x, unsigned int y) {
-    // Verifica flag de parada global
-    if (global_stop) return 0;
-    
-    // Verificação periódica de mensagens de outros processos
-    static int check_counter = 0;
-    check_counter++;
+int executa_recozimento() {
+    game *g = NULL;
+    int info[2] = { 0, 0 };
+    if (rank == 0) {
+        entrada *in = le_entrada(stdin);
+        g = initialize(in);
+        libera_entrada(in);
+        if (!g) MPI_Abort(MPI_COMM_WORLD, 1);
+        printf("Tabuleiro: %ux%u, %u peças\n", g->size, g->size, g->tile_count);
+        info[0] = g->size;
+        info[1] = g->ncolors;
+    }
+    MPI_Bcast(info, 2, MPI_INT, 0, job_comm);
+    if (rank != 0) {
+        g = calloc(1, sizeof(game));
+        g->size = info[0];
+        g->tile_count = g->size * g->size;
+        g->ncolors = info[1];
+        g->stride = g->size + 2;
+        g->tiles = malloc(g->tile_count * sizeof(tile));
+    }
+    MPI_Bcast(g->tiles, g->tile_count * sizeof(tile), MPI_BYTE, 0, job_comm);
+    if (rank != 0) build_pieces(g);
+    const char *motivo = inviabilidade(g);
+    if (motivo) {
+        if (rank == 0) printf("Instância sem solução: %s\n\nSOLUÇÃO NÃO ENCONTRADA\n", motivo);
+        free_resources(g);
+        return 0;
+    }
+    // As peças só trocam de lugar dentro da sua classe (quina, borda ou
+    // interna), o que exige a cor 0 só no contorno; inviabilidade aceita
+    // lados 0 no interior
+    if (!contagens_consistentes(g)) {
+        if (rank == 0)
+            printf("Recozimento simulado exige a cor 0 só no contorno, com as contagens de "
+                   "quinas e bordas do tabuleiro (use a busca exata)\n\nSOLUÇÃO NÃO ENCONTRADA\n");
+        free_resources(g);
+        return 0;
+    }
     
-    if (check_counter % 1000 == 0) {
-        int flag;
-        MPI_Status status;
-        MPI_Iprobe(MPI_ANY_SOURCE, 999, MPI_COMM_WORLD, &flag, &status);
-        
-        if (flag) {
-            int stop_signal;
-            MPI_Recv(&stop_signal, 1, MPI_INT, status.MPI_SOURCE, 999, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            global_solution_found = 1;
-            solution_owner = stop_signal;
-            return 0; // Para o backtracking imediatamente
-        }
+    // Deslocamentos até os vizinhos, como em build_order, e células por classe
+    g->offset[0] = -(int)g->stride;
+    g->offset[1] = 1;
+    g->offset[2] = g->stride;
+    g->offset[3] = -1;
+    for (int k = 0; k < 3; k++) {
+        sa_cells[k] = malloc(g->tile_count * sizeof(unsigned int));
+        sa_count[k] = 0;
     }
+    for (unsigned int y = 0; y < g->size; y++)
+        for (unsigned int x = 0; x < g->size; x++) {
+            unsigned int sides = (x == 0) + (y == 0) + (x == g->size - 1) + (y == g->size - 1);
+            int k = sides >= 2 ? 0 : sides == 1 ? 1 : 2;
+            sa_cells[k][sa_count[k]++] = CELL(g, x, y);
+        }
     
-    // Para se outro processo já encontrou solução
-    if (global_solution_found) {
+    // inicia_cadeia põe as peças de cada classe nas células da classe: as
+    // contagens precisam ser iguais
+    unsigned int tiles[3] = { 0, 0, 0 };
+    int unmatched = 0;
+    for (unsigned int id = 0; id < g->tile_count; id++) {
+        int k = classe_da_peca(g, id);
+        if (k < 0) unmatched++;
+        else tiles[k]++;
+    }
+    if (unmatched || tiles[0] != sa_count[0] || tiles[1] != sa_count[1] || tiles[2] != sa_count[2]) {
+        if (rank == 0)
+            printf("Recozimento simulado: peças de quina, borda e internas não batem com as "
+                   "células de cada classe\n\nSOLUÇÃO NÃO ENCONTRADA\n");
+        for (int k = 0; k < 3; k++)
+            free(sa_cells[k]);
+        free_resources(g);
         return 0;
     }
-
-    // Tenta cada peça disponível na posição atual
-    for (int i = 0; i < game->tile_count; i++) {
-        if (game->tiles[i].used) continue;
+    
+    if (rank == 0)
+        printf("Recozimento simulado - %d processos x %d cadeias, %u arestas internas\n",
+               size, nthreads, 2 * g->size * (g->size - 1));
+    
+    size_t cells = g->stride * g->stride;
+    cadeia *chains = malloc(nthreads * sizeof(cadeia));
+    for (int t = 0; t < nthreads; t++)
+        inicia_cadeia(g, &chains[t], 0x9E3779B97F4A7C15ULL * (rank * nthreads + t + 1));
+    unsigned short *global_best = malloc(cells * sizeof(unsigned short));
+    struct { int cost; int rank; } local, best;
+    int stop = 0, epochs = 0;
+    double start = get_time(), report = start;
+    
+    while (!stop) {
+#ifdef _OPENMP
+        #pragma omp parallel for num_threads(nthreads)
+#endif
+        for (int t = 0; t < nthreads; t++)
+            epoca(g, &chains[t]);
+        epochs++;
         
-        tile *tile = &game->tiles[i];
-        tile->used = 1;
+        int best_t = 0, worst_t = 0;
+        for (int t = 1; t < nthreads; t++) {
+            if (chains[t].best_cost < chains[best_t].best_cost) best_t = t;
+            if (chains[t].cost > chains[worst_t].cost) worst_t = t;
+        }
+        local.cost = chains[best_t].best_cost;
+        local.rank = rank;
+        MPI_Allreduce(&local, &best, 1, MPI_2INT, MPI_MINLOC, job_comm);
+        if (rank == best.rank) memcpy(global_best, chains[best_t].best, cells * sizeof(unsigned short));
+        MPI_Bcast(global_best, cells, MPI_UNSIGNED_SHORT, best.rank, job_comm);
         
-        // Testa todas as 4 rotações da peça
-        for (int rot = 0; rot < 4; rot++) {
-            tile->rotation = rot;
-            
-            if (valid_move(game, x, y, tile)) {
-                game->board[x][y] = tile;
-                
-                // Calcula próxima posição a preencher
-                unsigned int nx, ny;
-                ny = nx = game->size;
-                if (x < game->size - 1) {
-                    nx = x + 1;
-                    ny = y;
-                } else if (y < game->size - 1) {
-                    nx = 0;
-                    ny = y + 1;
-                }
-                
-                // Se completou tabuleiro ou recursão encontrou solução
-                if (ny == game->size || play(game, nx, ny)) {
-                    global_stop = 1; // Sinaliza parada global
-                    
-                    // Envia sinal de parada para todos os outros processos
-                    for (int p = 0; p < size; p++) {
-                        if (p != rank) {
-                            MPI_Send(&rank, 1, MPI_INT, p, 999, MPI_COMM_WORLD);
-                        }
-                    }
-                    return 1;
-                }
-                
-                // Remove peça do tabuleiro (backtrack)
-                game->board[x][y] = NULL;
+        // A pior cadeia do processo continua a partir do melhor global
+        cadeia *w = &chains[worst_t];
+        if (w->cost > (unsigned int)best.cost) {
+            memcpy(w->board, global_best, cells * sizeof(unsigned short));
+            w->cost = best.cost;
+            if ((unsigned int)best.cost < w->best_cost) {
+                memcpy(w->best, global_best, cells * sizeof(unsigned short));
+                w->best_cost = best.cost;
             }
         }
-        tile->used = 0;
+        
+        if (rank == 0) {
+            double now = get_time();
+            stop = best.cost == 0 || tempo_esgotado();
+            time_expired = best.cost > 0 && stop;
+            if (stats_interval > 0 && now - report >= stats_interval) {
+                fprintf(stderr, "Recozimento: %.1f s, %d épocas, melhor com %d arestas não casadas\n",
+                        now - start, epochs, best.cost);
+                report = now;
+            }
+        }
+        MPI_Bcast(&stop, 1, MPI_INT, 0, job_comm);
+    }
+    double elapsed = get_time() - start;
+    
+    unsigned long long local_steps[2] = { 0, 0 }, steps[2];
+    for (int t = 0; t < nthreads; t++) {
+        local_steps[0] += chains[t].steps;
+        local_steps[1] += chains[t].accepted;
+        free(chains[t].board);
+        free(chains[t].best);
+    }
+    MPI_Reduce(local_steps, steps, 2, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, job_comm);
+    
+    if (rank == 0) {
+        if (best.cost == 0) {
+            printf("Processo %d encontrou solução em %.6f segundos\n", best.rank, elapsed);
+            printf("\n=== SOLUÇÃO ENCONTRADA ===\n");
+        } else {
+            if (time_expired)
+                printf("\nTempo limite de %g segundos esgotado: busca interrompida\n", time_limit);
+            printf("\n=== MELHOR TABULEIRO (processo %d) ===\n", best.rank);
+            printf("%d de %u arestas internas não casadas\n", best.cost,
+                   2 * g->size * (g->size - 1));
+        }
+        for (unsigned int y = 0; y < g->size; y++)
+            for (unsigned int x = 0; x < g->size; x++) {
+                unsigned short ref = global_best[CELL(g, x, y)];
+                printf("%u %u\n", PIECE_ID(ref), PIECE_ROT(ref));
+            }
+        printf("\n=== Estatísticas do recozimento ===\n");
+        printf("Passos: %llu (%.0f passos/s), aceitos: %llu\n", steps[0],
+               elapsed > 0 ? steps[0] / elapsed : 0.0, steps[1]);
+        printf("Épocas: %d de %d passos por cadeia\n", epochs, SA_EPOCH);
+        if (best.cost > 0) printf("\nSOLUÇÃO NÃO ENCONTRADA\n");
     }
+    
+    free(global_best);
+    free(chains);
+    for (int k = 0; k < 3; k++)
+        free(sa_cells[k]);
+    free_resources(g);
+    return best.cost == 0;
+}
+
+/*
+ * Modo um processo por nó (-n)
+ * Em cada nó, só o processo de menor rank (o líder) busca, com as threads
+ * de todos os processos do nó (-t vezes o número de processos; sem -t,
+ * 1 por processo; com -t 0, o padrão do OpenMP), sobre um único jogo
+ * somente leitura compartilhado por elas. Os líderes formam job_comm, de
+ * modo que a troca de trabalho e a parada custam mensagens por nó, e não
+ * por núcleo. Os demais processos não alocam nada e dormem até o fim.
+ * Retorna 1 no líder, que continua com rank e size de job_comm
+ */
+int por_no() {
+    MPI_Comm node_comm;
+    int node_rank, node_size, world_size = size;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node_comm);
+    MPI_Comm_rank(node_comm, &node_rank);
+    MPI_Comm_size(node_comm, &node_size);
+    MPI_Comm_free(&node_comm);
+    MPI_Comm_split(MPI_COMM_WORLD, node_rank == 0 ? 0 : MPI_UNDEFINED, rank, &job_comm);
+    if (node_rank != 0) return 0;
+    
+    MPI_Comm_rank(job_comm, &rank);
+    MPI_Comm_size(job_comm, &size);
+    if (nthreads > 0) nthreads *= node_size;
+    if (rank == 0)
+        printf("Um processo por nó: %d processos em %d nós\n", world_size, size);
+    return 1;
+}
+
+/*
+ * Espera, sem ocupar a CPU, que os líderes terminem (processos que não são
+ * líderes com -n); o MPI_Ibarrier casa com o de finaliza()
+ * Retorna o código de saída do processo
+ */
+int libera_no() {
+    MPI_Request req;
+    int done = 0;
+    MPI_Ibarrier(MPI_COMM_WORLD, &req);
+    while (MPI_Test(&req, &done, MPI_STATUS_IGNORE), !done)
+        usleep(10000);
+    MPI_Finalize();
     return 0;
 }
 
 /*
- * Imprime a solução encontrada no formato esperado
+ * Encerra o MPI; com -n, libera antes os processos que esperam em libera_no()
  */
-void print_solution(game *game) {
-    printf("\n=== SOLUÇÃO ENCONTRADA ===\n");
-    for(unsigned int j = 0; j < game->size; j++) {
-        for(unsigned int i = 0; i < game->size; i++) {
-            tile *t = game->board[i][j];
-            printf("%u %u\n", t->id, t->rotation);
-        }
+void finaliza() {
+    if (node_mode) {
+        MPI_Request req;
+        MPI_Ibarrier(MPI_COMM_WORLD, &req);
+        MPI_Wait(&req, MPI_STATUS_IGNORE);
+        MPI_Comm_free(&job_comm);
     }
-    printf("=========================\n");
+    MPI_Finalize();
 }
 
 /*
@@ -373,154 +4214,319 @@ void print_solution(game *game) {
  * Implementa estratégia de paralelização baseada em distribuição de quinas
  */
 int main(int argc, char **argv) {
-    // Inicialização MPI
-    MPI_Init(&argc, &argv);
+    // Inicialização MPI: apenas a thread principal faz chamadas MPI
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
     
+    // Opções: -t número de threads por processo (0 = padrão do OpenMP),
+    // -f verificação adiante, -o ordem de visita das células, -c/-e contagem
+    // ou enumeração de todas as soluções, -r incluindo as rotações,
+    // -k/-i checkpoints periódicos, --resume retomada de um checkpoint,
+    // -s relatório periódico de progresso, -b modo lote, -p melhor
+    // tabuleiro parcial, -l tempo limite, -a recozimento simulado, -n um
+    // processo por nó, -d busca determinística, --estimate só a estimativa
+    // do tamanho da árvore, -m tabela de becos sem saída, --progress fluxo
+    // de progresso em JSON, -g últimas células no dispositivo
+    static struct option long_options[] = {
+        { "estimate", no_argument, NULL, 'E' },
+        { "per-node", no_argument, NULL, 'n' },
+        { "checkpoint", required_argument, NULL, 'k' },
+        { "checkpoint-interval", required_argument, NULL, 'i' },
+        { "resume", required_argument, NULL, 'R' },
+        { "progress", required_argument, NULL, 'P' },
+        { "progress-interval", required_argument, NULL, 'I' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt, bad_option = 0;
+    const char *solutions_path = NULL;
+    const char *resume_path = NULL;
+    int estimate_only = 0;
+    time_start = get_time();
+    while ((opt = getopt_long(argc, argv, "t:fo:ce:rk:i:s:bpl:andm:g:", long_options, NULL)) != -1) {
+        if (opt == 't') {
+            nthreads = atoi(optarg);
+        } else if (opt == 'f') {
+            forward_checking = 1;
+        } else if (opt == 'c') {
+            count_mode = 1;
+        } else if (opt == 'e') {
+            count_mode = 2;
+            solutions_path = optarg;
+        } else if (opt == 'r') {
+            all_rotations = 1;
+        } else if (opt == 'k') {
+            checkpoint_path = optarg;
+        } else if (opt == 'i') {
+            checkpoint_interval = atof(optarg);
+            if (checkpoint_interval <= 0) bad_option = 1;
+        } else if (opt == 'R') {
+            resume_path = optarg;
+        } else if (opt == 'E') {
+            estimate_only = 1;
+        } else if (opt == 'P') {
+            progress_path = optarg;
+        } else if (opt == 'I') {
+            progress_interval = atof(optarg);
+            if (progress_interval <= 0) bad_option = 1;
+        } else if (opt == 'b') {
+            batch_mode = 1;
+        } else if (opt == 'p') {
+            partial_mode = 1;
+        } else if (opt == 'a') {
+            annealing = 1;
+        } else if (opt == 'n') {
+            node_mode = 1;
+        } else if (opt == 'd') {
+            deterministic = 1;
+        } else if (opt == 'm') {
+            cache_mb = atoi(optarg);
+            if (cache_mb == 0) bad_option = 1;
+        } else if (opt == 'g') {
+            gpu_cells = atoi(optarg);
+            if (gpu_cells == 0) bad_option = 1;
+        } else if (opt == 'l') {
+            time_limit = atof(optarg);
+            if (time_limit <= 0) bad_option = 1;
+        } else if (opt == 's') {
+            stats_interval = atof(optarg);
+            if (stats_interval <= 0) bad_option = 1;
+        } else if (opt == 'o') {
+            for (cell_order = ORDEM_MRV; cell_order > 0; cell_order--)
+                if (strcmp(optarg, order_names[cell_order]) == 0) break;
+            if (strcmp(optarg, order_names[cell_order]) != 0) bad_option = 1;
+        } else {
+            bad_option = 1;
+        }
+        // O lote não tem checkpoints nem arquivos de soluções por processo
+        if (batch_mode && (checkpoint_path || resume_path || count_mode == 2)) bad_option = 1;
+        // Contando todas as soluções não há um tabuleiro parcial a mostrar
+        if (partial_mode && count_mode) bad_option = 1;
+        // O recozimento não tem árvore a dividir, contar ou retomar
+        if (annealing && (count_mode || partial_mode || batch_mode || checkpoint_path ||
+                          resume_path || cache_mb))
+            bad_option = 1;
+        // A ordem só vale para a primeira solução, e a fila de uma retomada
+        // não está na ordem da busca serial
+        if (deterministic && (count_mode || annealing || resume_path)) bad_option = 1;
+        // A estimativa é feita ao gerar as unidades de uma busca nova
+        if (estimate_only && (batch_mode || annealing || resume_path)) bad_option = 1;
+        // O progresso acompanha a fila de unidades de uma única busca
+        if (progress_path && (batch_mode || annealing)) bad_option = 1;
+        // O dispositivo só conta ou acha uma solução: nada dos lotes vai
+        // para checkpoints, tabela de becos, parciais ou arquivos, e suas
+        // células seguem uma ordem estática
+        if (gpu_cells && (deterministic || count_mode == 2 || partial_mode || cache_mb ||
+                          checkpoint_path || resume_path || annealing || batch_mode ||
+                          cell_order == ORDEM_MRV))
+            bad_option = 1;
+        if (bad_option) {
+            if (rank == 0)
+                fprintf(stderr, "Uso: %s [-n] [-t threads] [-f] [-o linha|moldura|espiral|mrv] "
+                        "[-c | -e arquivo | -p] [-r] [-d] [-m MiB] [-g células] [-l segundos] [-k arquivo] [-i segundos] "
+                        "[-s segundos] [--resume arquivo] [--estimate] [--progress arquivo] "
+                        "[--progress-interval segundos] < entrada\n"
+                        "       %s -a [-t cadeias] [-l segundos] [-s segundos] < entrada\n"
+                        "       %s -b [-t threads] [-f] [-o ordem] [-c [-r] | -p] [-d] [-m MiB] [-l segundos] "
+                        "[arquivos...]\n",
+                        argv[0], argv[0], argv[0]);
+            MPI_Finalize();
+            return 1;
+        }
+    }
+    if (node_mode && !por_no()) return libera_no();
+#ifdef _OPENMP
+    if (nthreads <= 0) nthreads = omp_get_max_threads();
+#else
+    nthreads = 1;
+#endif
+    if (nthreads < 1 || provided < MPI_THREAD_FUNNELED) nthreads = 1;
+    
+    if (batch_mode) {
+        executa_lote(argc - optind, argv + optind);
+        finaliza();
+        return 0;
+    }
+    if (annealing) {
+        int solved = executa_recozimento();
+        finaliza();
+        return solved ? 0 : 1;
+    }
+    
     game *g = NULL;
     corner_info *corners = NULL;
     int num_corners = 0;
     int solution_found = 0;
     
-    // Processo 0 inicializa o jogo e identifica quinas
+    // Processo 0 inicializa o jogo, identifica quinas e gera as unidades de trabalho
     if (rank == 0) {
-        g = initialize(stdin);
+        entrada *in = le_entrada(stdin);
+        g = initialize(in);
+        libera_entrada(in);
+        if (!g) MPI_Abort(MPI_COMM_WORLD, 1);
         printf("Tabuleiro: %ux%u, %u peças\n", g->size, g->size, g->tile_count);
         corners = separar_pecas_de_quina(g, &num_corners);
+        const char *motivo = num_corners > 0 ? inviabilidade(g) : NULL;
+        if (motivo) {
+            // Sem unidades, nenhum processo busca
+            printf("Instância sem solução: %s\n", motivo);
+        } else if (num_corners > 0) {
+            build_masks(g);
+            fixa_quina_canonica(g, escolhe_quina_canonica(g, corners, num_corners));
+            if (deterministic)
+                printf("Modo determinístico: unidades na ordem da busca serial\n\n");
+            else
+                printf("Quina canônica: peça %d na quina superior esquerda\n\n", g->canon_tile);
+            build_order(g);
+            alloc_workers(g);
+            if (resume_path)
+                carrega_checkpoint(g, &workers[0], resume_path, size);
+            else
+                gera_unidades(g, &workers[0], size);
+        }
     }
     
-    // Broadcast do número de quinas para todos os processos
-    MPI_Bcast(&num_corners, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    // Único broadcast global: o que todos precisam para saber se participam
+    int info[3] = { 0, 0, 0 };
+    if (rank == 0) {
+        info[0] = num_corners;
+        info[1] = num_units;
+        info[2] = g->tile_count;
+    }
+    MPI_Bcast(info, 3, MPI_INT, 0, job_comm);
+    num_corners = info[0];
+    num_units = info[1];
     
     // Verifica se há quinas disponíveis
     if (num_corners == 0) {
         if (rank == 0) printf("Nenhuma quina encontrada!\n");
-        MPI_Finalize();
+        finaliza();
         return 1;
     }
+    // --estimate: gera_unidades já imprimiu a estimativa
+    if (estimate_only) {
+        finaliza();
+        return 0;
+    }
     
-    // Otimização: limita número de processos ativos ao número de quinas
-    int effective_processes = (size < num_corners) ? size : num_corners;
-    int active = (rank < effective_processes);
+    // Otimização: limita número de processos ativos ao número de unidades.
+    // O comunicador dos ativos é criado antes de qualquer outra comunicação,
+    // e todas as coletivas seguintes ficam restritas a ele.
+    nactive = (size < num_units) ? size : num_units;
+    int active = (rank < nactive);
+    MPI_Comm_split(job_comm, active ? 0 : MPI_UNDEFINED, rank, &work_comm);
     
     if (rank == 0) {
-        printf("Eternity II Paralelo - %d processos (%d ativos para %d quinas)\n", 
-               size, effective_processes, num_corners);
+        printf("Eternity II Paralelo - %d processos x %d threads (%d ativos, %d unidades "
+               "de trabalho com prefixos de %d células, ordem %s)\n", 
+               size, nthreads, nactive, num_units, work_depth, order_names[cell_order]);
     }
     
     // Apenas processos ativos participam da resolução
     if (active) {
-        // Processos não-zero recebem dados do jogo via broadcast
-        if (rank != 0) {
-            unsigned int game_size, tile_count;
-            MPI_Bcast(&game_size, 1, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-            MPI_Bcast(&tile_count, 1, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-            
-            // Aloca estruturas de dados locais
-            g = malloc(sizeof(game));
-            g->size = game_size;
-            g->tile_count = tile_count;
-            g->board = malloc(sizeof(tile**) * game_size);
-            for(int i = 0; i < game_size; i++)
-                g->board[i] = calloc(game_size, sizeof(tile*));
-            g->tiles = malloc(tile_count * sizeof(tile));
-            
-            corners = malloc(num_corners * sizeof(corner_info));
-        } else {
-            MPI_Bcast(&g->size, 1, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-            MPI_Bcast(&g->tile_count, 1, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-        }
+        g = distribui_jogo(g, info[2]);
         
-        // Broadcast das peças e informações de quinas
-        MPI_Bcast(g->tiles, g->tile_count * sizeof(tile), MPI_BYTE, 0, MPI_COMM_WORLD);
-        MPI_Bcast(corners, num_corners * sizeof(corner_info), MPI_BYTE, 0, MPI_COMM_WORLD);
+        // Threads de uma unidade só roubam dos níveis abaixo de steal_limit
+        if (nthreads > 1 && g->ncells > STEAL_CUTOFF)
+            g->steal_limit = g->ncells - STEAL_CUTOFF;
+        
+        if (gpu_cells) {
+            prepara_gpu(g);
+            if (rank == 0 && gpu_cells)
+                printf("Dispositivo: %d aceleradores visíveis%s; células %u a %u completadas em "
+                       "lotes de %d\n\n", gpu_devices, gpu_devices ? "" : " (lotes no hospedeiro)",
+                       g->frontier + 1, g->ncells, GPU_BATCH);
+        }
         
-        // Cada processo ativo trabalha com uma quina diferente
-        int corner_idx = rank;
+        // Cada thread tem no máximo ncells níveis pendentes
+        if (checkpoint_path)
+            task_buf = malloc(nthreads * g->ncells * (g->ncells + 3) * sizeof(unsigned short));
         
-        // Inicializa tabuleiro vazio
-        for (int i = 0; i < g->size; i++) {
-            for (int j = 0; j < g->size; j++) {
-                g->board[i][j] = NULL;
+        if (rank == 0 && progress_path) {
+            progress_file = fopen(progress_path, "w");
+            if (!progress_file) {
+                fprintf(stderr, "Não foi possível criar %s\n", progress_path);
+                MPI_Abort(MPI_COMM_WORLD, 1);
             }
         }
         
-        for (int i = 0; i < g->tile_count; i++) {
-            g->tiles[i].used = 0;
+        if (count_mode == 2) {
+            char path[4096];
+            snprintf(path, sizeof(path), "%s.%d", solutions_path, rank);
+            // Na retomada, as soluções seguem as já gravadas
+            solutions_file = fopen(path, resume_path ? "a" : "w");
+            if (!solutions_file) {
+                fprintf(stderr, "Processo %d: não foi possível criar %s\n", rank, path);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
         }
         
-        // Determina posição da quina baseada no tipo
-        unsigned int corner_x = 0, corner_y = 0;
-        switch(corners[corner_idx].corner_type) {
-            case 0: corner_x = 0; corner_y = 0; break;                    // Superior esquerda
-            case 1: corner_x = g->size-1; corner_y = 0; break;            // Superior direita
-            case 2: corner_x = 0; corner_y = g->size-1; break;            // Inferior esquerda
-            case 3: corner_x = g->size-1; corner_y = g->size-1; break;    // Inferior direita
+        // Os contadores medem apenas a busca, não a geração das unidades
+        for (int t = 0; t < nthreads; t++) {
+            memset(&workers[t].stats, 0, sizeof(workers[t].stats));
+            memset(workers[t].depth_nodes, 0, (g->ncells + 1) * sizeof(unsigned long long));
+            workers[t].reported_nodes = 0;
+            workers[t].reported_depth = 0;
         }
-        
-        // Coloca a peça de quina no tabuleiro
-        tile *corner_tile = &g->tiles[corners[corner_idx].tile_id];
-        corner_tile->rotation = corners[corner_idx].rotation;
-        corner_tile->used = 1;
-        g->board[corner_x][corner_y] = corner_tile;
+        stats_start = last_report = get_time();
         
         // Inicia medição de tempo
         double start_time = MPI_Wtime();
         
-        // Encontra primeira posição vazia para começar backtracking
-        unsigned int start_x = g->size, start_y = g->size;
-        for (unsigned int y = 0; y < g->size && start_y == g->size; y++) {
-            for (unsigned int x = 0; x < g->size; x++) {
-                if (g->board[x][y] == NULL) {
-                    start_x = x;
-                    start_y = y;
-                    break;
-                }
-            }
-        }
-        
-        // Executa algoritmo de backtracking
-        int local_solution = 0;
-        if (start_y < g->size) {
-            local_solution = play(g, start_x, start_y);
-        }
+        // Processo 0 distribui a fila e também busca; os demais pedem unidades
+        int local_solution = (rank == 0) ? mestre(g, nactive - 1) : trabalhador(g);
+        if (progress_file) fclose(progress_file);
         
         double end_time = MPI_Wtime();
         
-        // Sincronização apenas entre processos ativos
-        MPI_Comm active_comm;
-        MPI_Comm_split(MPI_COMM_WORLD, 1, rank, &active_comm);
-        
-        // Verifica se algum processo encontrou solução
-        int global_result;
-        MPI_Allreduce(&local_solution, &global_result, 1, MPI_INT, MPI_MAX, active_comm);
-        
-        if (global_result) {
+        if (count_mode) {
+            // Soma as soluções das threads e depois as dos processos
+            unsigned long long local_count = soma_solucoes(), total = 0;
+            descarrega_processo();
+            if (solutions_file) fclose(solutions_file);
+            MPI_Reduce(&local_count, &total, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, work_comm);
+            if (rank == 0) {
+                total += resumed_solutions * (all_rotations ? 4 : 1);
+                total = pondera_solucoes(g, total);
+                char text[COUNT_TEXT];
+                printf("Total de soluções%s: %s\n",
+                       all_rotations ? "" : " (a menos de rotação)", formata_contagem(text, total));
+                printf("Tempo de execução: %.6f segundos\n", end_time - start_time);
+                solution_found = (total > 0);
+            }
+        } else if (solution_owner >= 0) {
+            // O anúncio de parada já diz qual processo encontrou solução
             solution_found = 1;
             
-            // Determina qual processo encontrou a solução
-            int winner_rank = -1;
-            int has_solution = local_solution ? rank : effective_processes;
-            MPI_Allreduce(&has_solution, &winner_rank, 1, MPI_INT, MPI_MIN, active_comm);
-            
             // Imprime resultado
-            if (local_solution && rank == winner_rank) {
+            if (local_solution && rank == solution_owner) {
                 printf("Processo %d encontrou solução e vai imprimi-la!\n", rank);
                 printf("Tempo de execução: %.6f segundos\n", end_time - start_time);
-                print_solution(g);
-            } else if (rank == 0 && winner_rank != 0) {
+                print_solution(g, &workers[winner]);
+            } else if (rank == 0) {
                 printf("Processo %d encontrou a solução em %.3f segundos.\n", 
-                       winner_rank, end_time - start_time);
+                       solution_owner, end_time - start_time);
                 printf("Processo %d parou busca antecipadamente.\n", rank);
             }
         }
         
-        MPI_Comm_free(&active_comm);
+        if (partial_mode && solution_owner < 0) reduz_parcial(g);
+        if (rank == 0 && time_expired)
+            printf("\nTempo limite de %g segundos esgotado: busca interrompida\n", time_limit);
+        
+        imprime_estatisticas(g, end_time - start_time);
+        libera_gpu(g);
+        
+        // A busca terminou, e o checkpoint não tem mais o que retomar (com o
+        // tempo esgotado, fica para a retomada)
+        if (rank == 0 && checkpoint_path && !time_expired) remove(checkpoint_path);
+        
+        MPI_Comm_free(&work_comm);
     }
     
     // Broadcast do resultado final para todos os processos
-    MPI_Bcast(&solution_found, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&solution_found, 1, MPI_INT, 0, job_comm);
     
     if (!solution_found && rank == 0) {
         printf("\nSOLUÇÃO NÃO ENCONTRADA\n");
@@ -528,8 +4534,18 @@ int main(int argc, char **argv) {
     
     // Liberação de recursos
     if (corners) free(corners);
+    free(work_units);
+    free(unit_start);
+    free(task_buf);
+    free(ordered_path);
+    free((void *)dead_cache);
+    if (workers) {
+        for (int t = 0; t < nthreads; t++)
+            free_search(&workers[t]);
+        free(workers);
+    }
     if (g) free_resources(g);
     
-    MPI_Finalize();
+    finaliza();
     return solution_found ? 0 : 1;
 } 
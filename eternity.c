@@ -7,87 +7,305 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <assert.h>
+#include <string.h>
 
 typedef struct {
-  unsigned int colors[4];
-  unsigned char rotation;
-  unsigned int id;
-  int used;
+  unsigned char colors[4];
 } tile;
 
-#define X_COLOR(t, s) (t->colors[(s + 4 - t->rotation) % 4])
-#define N_COLOR(t) (X_COLOR(t, 0))
-#define E_COLOR(t) (X_COLOR(t, 1))
-#define S_COLOR(t) (X_COLOR(t, 2))
-#define W_COLOR(t) (X_COLOR(t, 3))
+//A piece is a tile in a given rotation with its colors already resolved
+//and packed one byte per side: N | E << 8 | S << 16 | W << 24
+typedef unsigned int piece;
+
+#define PACK(n, e, s, w) ((piece)(n) | (piece)(e) << 8 | (piece)(s) << 16 | (piece)(w) << 24)
+#define X_COLOR(p, s) (((p) >> (8 * (s))) & 0xff)
+#define N_COLOR(p) (X_COLOR(p, 0))
+#define E_COLOR(p) (X_COLOR(p, 1))
+#define S_COLOR(p) (X_COLOR(p, 2))
+#define W_COLOR(p) (X_COLOR(p, 3))
+
+//Pieces are referred to by tile id * 4 + rotation
+#define PIECE_ID(ref) ((ref) >> 2)
+#define PIECE_ROT(ref) ((ref) & 3)
+#define EMPTY 0xffff
+//The board is surrounded by a ring of BORDER cells whose piece has all
+//sides 0-colored, so the border rule is just another neighbour check
+#define BORDER(g) (4 * (g)->tile_count)
+
+//Cells are classified by which of their east/south sides lie on the border
+#define EAST_BORDER 1
+#define SOUTH_BORDER 2
+#define CELL_CLASSES 4
+
+//One level of the explicit search stack: the candidates of the cell being
+//filled at this depth that are still to be tried are next..end-1
+typedef struct {
+  unsigned int next;
+  unsigned int end;
+} frame;
 
 typedef struct {
   unsigned int size;
   unsigned int tile_count; //==size^2
-  tile ***board;
+  unsigned int ncolors;
+  unsigned int stride; //==size + 2
+  //row-major (size + 2)^2 piece refs including the sentinel ring, EMPTY
+  //if the cell is free
+  unsigned short *board;
   tile *tiles;
+  unsigned char *used;
+  piece *pieces; //indexed by piece ref, plus one all-0 BORDER piece
+  //candidates[cand_start[k]..cand_start[k+1]) lists the piece refs that
+  //fit key k = CAND_KEY(class, west color, north color)
+  unsigned short *candidates;
+  unsigned int *cand_start;
+  //order[d] is the cell filled at depth d; stack[0..depth-1] have a piece
+  //placed and stack[depth] is the one being searched
+  unsigned int ncells;
+  unsigned int *order;
+  frame *stack;
+  unsigned int depth;
+  unsigned int base; //the search never backtracks above this depth
 } game;
 
-game *initialize (FILE *input) {
+#define CELL(g, x, y) (((y) + 1) * (g)->stride + (x) + 1)
+#define CAND_KEY(g, cls, w, n) (((cls) * ((g)->ncolors + 1) + (w)) * ((g)->ncolors + 1) + (n))
+
+//Resolves the colors of every tile in each of its 4 rotations
+void build_pieces (game *g) {
+  g->pieces = malloc((4 * g->tile_count + 1) * sizeof(piece));
+  g->pieces[BORDER(g)] = PACK(0, 0, 0, 0);
+  for (unsigned int i = 0; i < g->tile_count; i++)
+    for (int rot = 0; rot < 4; rot++) {
+      unsigned char *c = g->tiles[i].colors;
+      g->pieces[i * 4 + rot] = PACK(c[(4 - rot) % 4], c[(5 - rot) % 4],
+				    c[(6 - rot) % 4], c[(7 - rot) % 4]);
+    }
+}
+
+//Indexes every piece by the colors it shows to its west and north
+//neighbours and by the border class of the cell it may occupy, so play()
+//only iterates over pieces that can actually fit.
+void build_candidates (game *g) {
+  unsigned int nkeys = CELL_CLASSES * (g->ncolors + 1) * (g->ncolors + 1);
+  g->cand_start = calloc(nkeys + 1, sizeof(unsigned int));
+  g->candidates = malloc(CELL_CLASSES * 4 * g->tile_count * sizeof(unsigned short));
+
+  //counting sort keeps each list in (tile, rotation) order, which is the
+  //order the exhaustive scan used to try them in
+  for (int pass = 0; pass < 2; pass++) {
+    for (unsigned int cls = 0; cls < CELL_CLASSES; cls++)
+      for (unsigned int ref = 0; ref < 4 * g->tile_count; ref++) {
+	piece p = g->pieces[ref];
+	if ((cls & EAST_BORDER) && E_COLOR(p) != 0) continue;
+	if ((cls & SOUTH_BORDER) && S_COLOR(p) != 0) continue;
+	unsigned int k = CAND_KEY(g, cls, W_COLOR(p), N_COLOR(p));
+	if (pass == 0)
+	  g->cand_start[k + 1]++;
+	else
+	  g->candidates[g->cand_start[k]++] = ref;
+      }
+    if (pass == 0) {
+      for (unsigned int k = 0; k < nkeys; k++)
+	g->cand_start[k + 1] += g->cand_start[k];
+    } else {
+      //the fill pass advanced each start to the next list's start
+      for (unsigned int k = nkeys; k > 0; k--)
+	g->cand_start[k] = g->cand_start[k - 1];
+      g->cand_start[0] = 0;
+    }
+  }
+}
+
+//The whole input is read into memory with a few large freads and parsed in
+//a single pass, instead of one fscanf per number; line tracks the line of
+//pos for error messages
+typedef struct {
+  char *data;
+  size_t len;
+  size_t pos;
+  unsigned int line;
+} input_buffer;
+
+//Binary instances: BINARY_MAGIC, size and color count as 32-bit
+//little-endian integers, then the 4 color bytes of every tile. Text and
+//binary instances may be concatenated in the same input.
+#define BINARY_MAGIC "ETB1"
+#define BINARY_HEADER 12
+//Largest size whose piece refs (4 * size^2) fit below EMPTY
+#define MAX_SIZE 127
+
+input_buffer *read_input (FILE *input) {
+  input_buffer *in = malloc(sizeof(input_buffer));
+  size_t capacity = 1 << 16, n;
+  in->data = malloc(capacity);
+  in->len = 0;
+  while ((n = fread(in->data + in->len, 1, capacity - in->len, input)) > 0) {
+    in->len += n;
+    if (in->len == capacity) {
+      capacity *= 2;
+      in->data = realloc(in->data, capacity);
+    }
+  }
+  in->pos = 0;
+  in->line = 1;
+  return in;
+}
+
+void free_input (input_buffer *in) {
+  free(in->data);
+  free(in);
+}
+
+//Parses the next unsigned number of the text into value; what describes
+//the expected number in the error message. Returns 0 (after reporting the
+//error on stderr) if there is no valid number.
+int read_number (input_buffer *in, unsigned int *value, const char *what) {
+  while (in->pos < in->len && (in->data[in->pos] == ' ' || in->data[in->pos] == '\n' ||
+			       in->data[in->pos] == '\t' || in->data[in->pos] == '\r')) {
+    if (in->data[in->pos] == '\n') in->line++;
+    in->pos++;
+  }
+  if (in->pos == in->len) {
+    fprintf(stderr, "input, line %u: unexpected end of input, expected %s\n", in->line, what);
+    return 0;
+  }
+  unsigned long long v = 0;
+  size_t start = in->pos;
+  while (in->pos < in->len && in->data[in->pos] >= '0' && in->data[in->pos] <= '9' &&
+	 v <= 0xffffffffULL)
+    v = v * 10 + (in->data[in->pos++] - '0');
+  if (in->pos == start) {
+    fprintf(stderr, "input, line %u: unexpected character '%c', expected %s\n",
+	    in->line, in->data[in->pos], what);
+    return 0;
+  }
+  if (v > 0xffffffffULL) {
+    fprintf(stderr, "input, line %u: number too large in %s\n", in->line, what);
+    return 0;
+  }
+  *value = v;
+  return 1;
+}
+
+//Skips the whitespace after an instance. Returns 1 if another instance
+//follows in the input.
+int more_input (input_buffer *in) {
+  while (in->pos < in->len && (in->data[in->pos] == ' ' || in->data[in->pos] == '\n' ||
+			       in->data[in->pos] == '\t' || in->data[in->pos] == '\r')) {
+    if (in->data[in->pos] == '\n') in->line++;
+    in->pos++;
+  }
+  return in->pos < in->len;
+}
+
+unsigned int read_u32 (const char *p) {
+  const unsigned char *b = (const unsigned char *)p;
+  return b[0] | b[1] << 8 | b[2] << 16 | (unsigned int)b[3] << 24;
+}
+
+//Builds the game from the next instance of the input, text or binary.
+//Returns NULL after reporting on stderr if the instance is invalid.
+game *initialize (input_buffer *in) {
   unsigned int bsize;
   unsigned int ncolors;
-  int r = fscanf (input, "%u", &bsize);
-  assert (r == 1);
-  r = fscanf (input, "%u", &ncolors);
-  assert (r == 1);
-  assert (ncolors < 256);
+  int binary = in->len - in->pos >= BINARY_HEADER &&
+    memcmp(in->data + in->pos, BINARY_MAGIC, 4) == 0;
+  if (binary) {
+    bsize = read_u32(in->data + in->pos + 4);
+    ncolors = read_u32(in->data + in->pos + 8);
+    in->pos += BINARY_HEADER;
+  } else if (!read_number(in, &bsize, "the board size") ||
+	     !read_number(in, &ncolors, "the number of colors")) {
+    return NULL;
+  }
+  if (bsize < 1 || bsize > MAX_SIZE) {
+    fprintf(stderr, "input: size %u out of range 1..%d\n", bsize, MAX_SIZE);
+    return NULL;
+  }
+  if (ncolors > 255) {
+    fprintf(stderr, "input: %u colors, at most 255 are supported\n", ncolors);
+    return NULL;
+  }
+  if (binary && in->len - in->pos < 4 * (size_t)bsize * bsize) {
+    fprintf(stderr, "input: truncated binary instance\n");
+    return NULL;
+  }
+
+  //loads tiles
+  tile *tiles = malloc(bsize * bsize * sizeof(tile));
+  for (unsigned int i = 0; i < bsize * bsize; i++) {
+    for (int c = 0; c < 4; c++) {
+      unsigned int color;
+      if (binary) {
+	color = (unsigned char)in->data[in->pos++];
+      } else if (!read_number(in, &color, "a tile color")) {
+	free(tiles);
+	return NULL;
+      }
+      if (color > ncolors) {
+	fprintf(stderr, "input, %s %u: color %u exceeds the number of colors (%u)\n",
+		binary ? "tile" : "line", binary ? i : in->line, color, ncolors);
+	free(tiles);
+	return NULL;
+      }
+      tiles[i].colors[c] = color;
+    }
+  }
 
   //creates an empty board
   game *g = malloc (sizeof(game));
   g->size = bsize;
-  g->board = malloc (sizeof (tile**) * bsize);
-  for(int i = 0; i < bsize; i++)
-    g->board[i] = calloc(bsize, sizeof(tile*));
   g->tile_count = bsize * bsize;
+  g->stride = bsize + 2;
+  g->board = malloc (g->stride * g->stride * sizeof(unsigned short));
+  for (unsigned int i = 0; i < g->stride * g->stride; i++)
+    g->board[i] = BORDER(g);
+  for (unsigned int y = 0; y < bsize; y++)
+    for (unsigned int x = 0; x < bsize; x++)
+      g->board[CELL(g, x, y)] = EMPTY;
+  g->ncolors = ncolors;
+  g->tiles = tiles;
+  g->used = calloc(g->tile_count, sizeof(unsigned char));
 
-  //loads tiles
-  g->tiles = malloc(g->tile_count * sizeof(tile));
-  for (unsigned int i = 0; i < g->tile_count; i++) {
-    g->tiles[i].rotation = 0;
-    g->tiles[i].id = i;
-    g->tiles[i].used = 0;
-    for (int c = 0; c < 4; c++) {
-      r = fscanf(input, "%u", &g->tiles[i].colors[c]);
-      assert(r == 1);
-    }
-  }
+  //cells are filled in scanline order
+  g->ncells = g->tile_count;
+  g->order = malloc(g->ncells * sizeof(unsigned int));
+  for (unsigned int y = 0; y < bsize; y++)
+    for (unsigned int x = 0; x < bsize; x++)
+      g->order[y * bsize + x] = CELL(g, x, y);
+  g->stack = malloc(g->ncells * sizeof(frame));
 
+  build_pieces(g);
+  build_candidates(g);
   return g;
 }
 
 void free_resources(game *game) {
+  free(game->candidates);
+  free(game->cand_start);
+  free(game->pieces);
+  free(game->used);
+  free(game->order);
+  free(game->stack);
   free(game->tiles);
-  for(int i = 0; i < game->size; i++)
-    free(game->board[i]);
   free(game->board);
   free(game);
 }
 
-int valid_move (game *game, unsigned int x, unsigned int y, tile *tile) {
-  //The borders must be 0-colored
-  if (x == 0 && W_COLOR(tile) != 0) return 0;
-  if (y == 0 && N_COLOR(tile) != 0) return 0;
-  if (x == game->size - 1 && E_COLOR(tile) != 0) return 0;
-  if (y == game->size - 1 && S_COLOR(tile) != 0) return 0;
-
-  //The tile must also be compatible with its existing neighbours
-  if (x > 0 && game->board[x - 1][y] != NULL &&
-      E_COLOR(game->board[x - 1][y]) != W_COLOR(tile))
+//The tile must be compatible with its existing neighbours; the sentinel
+//ring makes the borders 0-colored neighbours
+int valid_move (game *game, unsigned int cell, piece p) {
+  unsigned short *b = game->board;
+  if (b[cell - 1] != EMPTY && E_COLOR(game->pieces[b[cell - 1]]) != W_COLOR(p))
     return 0;
-  if (x < game->size - 1 && game->board[x + 1][y] != NULL &&
-      W_COLOR(game->board[x + 1][y]) != E_COLOR(tile))
+  if (b[cell + 1] != EMPTY && W_COLOR(game->pieces[b[cell + 1]]) != E_COLOR(p))
     return 0;
-  if (y > 0 && game->board[x][y - 1] != NULL &&
-      S_COLOR(game->board[x][y - 1]) != N_COLOR(tile))
+  if (b[cell - game->stride] != EMPTY &&
+      S_COLOR(game->pieces[b[cell - game->stride]]) != N_COLOR(p))
     return 0;
-  if (y < game->size - 1 && game->board[x][y + 1] != NULL &&
-      N_COLOR(game->board[x][y + 1]) != S_COLOR(tile))
+  if (b[cell + game->stride] != EMPTY &&
+      N_COLOR(game->pieces[b[cell + game->stride]]) != S_COLOR(p))
     return 0;
 
   return 1;
@@ -97,47 +315,150 @@ int valid_move (game *game, unsigned int x, unsigned int y, tile *tile) {
 void print_solution (game *game) {
   for(unsigned int j = 0; j < game->size; j++)
     for(unsigned int i = 0; i < game->size; i++) {
-      tile *t = game->board[i][j];
-      printf("%u %u\n", t->id, t->rotation);
+      unsigned short ref = game->board[CELL(game, i, j)];
+      printf("%u %u\n", PIECE_ID(ref), PIECE_ROT(ref));
     }
 }
 
-int play (game *game, unsigned int x, unsigned int y) {
-  for (int i = 0; i < game->tile_count; i++) {
-    if (game->tiles[i].used) continue;
-    tile *tile = &game->tiles[i];
-    tile->used = 1;
-    for (int rot = 0; rot < 4; rot++) {//tries each side
-      tile->rotation = rot;
-      if (valid_move(game, x, y, tile)) {
-	game->board[x][y] = tile;
-	unsigned int nx, ny;
-	ny = nx = game->size;
-	if (x < game->size - 1) {
-	  nx = x + 1;
-	  ny = y;
-	} else if (y < game->size - 1) {
-	  nx = 0;
-	  ny = y + 1;
-	}
-	if (ny == game->size || play(game, nx, ny)) {
-	  return 1;
-	}
-	game->board[x][y] = NULL;
+//Points stack[d] to the candidates of the cell filled at depth d
+void open_frame (game *game, unsigned int d) {
+  unsigned short *b = game->board;
+  unsigned int cell = game->order[d];
+  //west and north neighbours are always placed in scanline order
+  unsigned int west = E_COLOR(game->pieces[b[cell - 1]]);
+  unsigned int north = S_COLOR(game->pieces[b[cell - game->stride]]);
+  unsigned int cls = (b[cell + 1] == BORDER(game) ? EAST_BORDER : 0) |
+    (b[cell + game->stride] == BORDER(game) ? SOUTH_BORDER : 0);
+  unsigned int k = CAND_KEY(game, cls, west, north);
+  game->stack[d].next = game->cand_start[k];
+  game->stack[d].end = game->cand_start[k + 1];
+}
+
+//Prepares a search that fills cells order[base..ncells-1]
+void start_search (game *game, unsigned int base) {
+  game->base = game->depth = base;
+  if (base < game->ncells)
+    open_frame(game, base);
+}
+
+//Iterative backtracking over the explicit stack. Returns 1 with the board
+//filled when a solution is found, and can be called again to resume the
+//search after it; returns 0 once every branch below base is exhausted.
+int play (game *game) {
+  unsigned short *b = game->board;
+  unsigned int d = game->depth;
+  if (d == game->ncells) {
+    //resuming after a solution: lift the last piece and keep going
+    if (d == game->base) return 0;
+    d--;
+    game->used[PIECE_ID(b[game->order[d]])] = 0;
+    b[game->order[d]] = EMPTY;
+  }
+  for (;;) {
+    frame *f = &game->stack[d];
+    unsigned int cell = game->order[d];
+    unsigned short ref = EMPTY;
+    while (f->next < f->end) {
+      unsigned short r = game->candidates[f->next++];
+      if (!game->used[PIECE_ID(r)] && valid_move(game, cell, game->pieces[r])) {
+	ref = r;
+	break;
+      }
+    }
+    if (ref != EMPTY) {
+      game->used[PIECE_ID(ref)] = 1;
+      b[cell] = ref;
+      if (++d == game->ncells) {
+	game->depth = d;
+	return 1;
       }
+      open_frame(game, d);
+    } else {
+      //no candidate left at this depth: backtrack
+      if (d == game->base) {
+	game->depth = d;
+	return 0;
+      }
+      d--;
+      game->used[PIECE_ID(b[game->order[d]])] = 0;
+      b[game->order[d]] = EMPTY;
     }
-    tile->used = 0;
   }
-  //no solution was found
-  return 0;
+}
+
+//Quick O(tiles) necessary conditions for a solution, checked before the
+//search. The outline has 4 * size sides, all 0-colored, and any other 0
+//sides must pair up inside the board. Every inner edge joins two sides of
+//the same color, so each other color appears an even number of times.
+//When the 0 sides exactly cover the outline, corner and border tiles are
+//known by their colors: there must be 4 corner tiles (two adjacent 0
+//sides), 4 * (size - 2) border tiles (one 0 side) and no other 0 sides,
+//and the even counts hold separately along the border (the sides next to
+//a 0 side, which only meet each other) and across the rest of the board
+int feasible (game *g) {
+  if (g->size == 1)
+    return g->pieces[0] == PACK(0, 0, 0, 0);
+  unsigned int corners = 0, edges = 0, others = 0, zeros_total = 0;
+  unsigned int *along = calloc(2 * (g->ncolors + 1), sizeof(unsigned int));
+  unsigned int *across = along + g->ncolors + 1;
+  for (unsigned int i = 0; i < g->tile_count; i++) {
+    unsigned char *c = g->tiles[i].colors;
+    int zeros = 0, adjacent = 0;
+    for (int s = 0; s < 4; s++) {
+      zeros += c[s] == 0;
+      zeros_total += c[s] == 0;
+      adjacent |= c[s] == 0 && c[(s + 1) % 4] == 0;
+      if (c[s] == 0)
+	continue;
+      if (c[(s + 1) % 4] == 0 || c[(s + 3) % 4] == 0)
+	along[c[s]]++;
+      else
+	across[c[s]]++;
+    }
+    if (zeros == 2 && adjacent)
+      corners++;
+    else if (zeros == 1)
+      edges++;
+    else if (zeros != 0)
+      others++;
+  }
+  unsigned int outline = 4 * g->size;
+  int ok = zeros_total >= outline && (zeros_total - outline) % 2 == 0;
+  if (zeros_total == outline) {
+    ok = ok && corners == 4 && edges == 4 * (g->size - 2) && others == 0;
+    for (unsigned int color = 1; color <= g->ncolors; color++)
+      if (along[color] % 2 || across[color] % 2)
+	ok = 0;
+  } else {
+    for (unsigned int color = 1; color <= g->ncolors; color++)
+      if ((along[color] + across[color]) % 2)
+	ok = 0;
+  }
+  free(along);
+  return ok;
 }
 
 
 int main (int argc, char **argv) {
-  game *g = initialize(stdin);
-  if (play(g, 0, 0))
-    print_solution(g);
-  else
-    printf("SOLUTION NOT FOUND");
-  free_resources(g);
-}
\ No newline at end of file
+  //Solves every instance of the input in turn, separating their results
+  //with a blank line
+  input_buffer *in = read_input(stdin);
+  unsigned int k = 0;
+  do {
+    game *g = initialize(in);
+    if (!g) {
+      free_input(in);
+      return 1;
+    }
+    if (k++ > 0)
+      printf("\n");
+    start_search(g, 0);
+    if (feasible(g) && play(g))
+      print_solution(g);
+    else
+      printf("SOLUTION NOT FOUND");
+    fflush(stdout);
+    free_resources(g);
+  } while (more_input(in));
+  free_input(in);
+}
@@ -0,0 +1,113 @@
+/*
+ * Gerador de instâncias aleatórias do Eternity II com solução garantida
+ *
+ * Sorteia as cores de todas as arestas internas de um tabuleiro N x N já
+ * resolvido, recorta as peças, embaralha sua ordem e gira cada uma
+ * aleatoriamente. A borda externa tem cor 0; as arestas entre duas peças
+ * da borda usam as cores 1..B e as demais as cores B+1..B+I, como no
+ * quebra-cabeça original. Menos cores produzem mais soluções e buscas mais
+ * longas; mais cores, instâncias com poucas soluções.
+ *
+ * Uso: ./gerador [-b] N [cores_de_borda] [cores_internas] [semente] > instancia.in
+ *   padrão: 5 cores de borda, 17 cores internas, semente 1
+ *   -b: grava no formato binário compacto aceito pelos solvers ("ETB1",
+ *       dimensão e cores em 32 bits little-endian, um byte por cor)
+ *
+ * Compilação: gcc -O2 -o gerador gerador.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Gerador xorshift64*: a mesma semente gera a mesma instância em qualquer plataforma */
+unsigned long long estado = 1;
+
+unsigned int sorteia(unsigned int n) {
+    estado ^= estado >> 12;
+    estado ^= estado << 25;
+    estado ^= estado >> 27;
+    return (unsigned int)((estado * 2685821657736338717ULL) >> 32) % n;
+}
+
+/* Escreve v em 32 bits little-endian */
+void escreve_u32(unsigned int v) {
+    for (int i = 0; i < 4; i++)
+        putchar((v >> (8 * i)) & 0xff);
+}
+
+int main(int argc, char **argv) {
+    int binario = argc > 1 && strcmp(argv[1], "-b") == 0;
+    if (binario) {
+        argv++;
+        argc--;
+    }
+    if (argc < 2 || argc > 5) {
+        fprintf(stderr, "Uso: %s [-b] N [cores_de_borda] [cores_internas] [semente]\n", argv[0]);
+        return 1;
+    }
+    int n = atoi(argv[1]);
+    int borda = argc > 2 ? atoi(argv[2]) : 5;
+    int internas = argc > 3 ? atoi(argv[3]) : 17;
+    estado = argc > 4 ? strtoull(argv[4], NULL, 10) : 1;
+    if (estado == 0) estado = 1;
+    if (n < 2 || borda < 1 || internas < 1 || borda + internas > 255) {
+        fprintf(stderr, "Parâmetros inválidos: N >= 2, cores >= 1 e no máximo 255 cores\n");
+        return 1;
+    }
+
+    // leste[y][x]: cor entre (x, y) e (x + 1, y); sul[y][x]: entre (x, y) e
+    // (x, y + 1); 0 nas arestas da borda externa
+    int *leste = calloc(n * n, sizeof(int));
+    int *sul = calloc(n * n, sizeof(int));
+    for (int y = 0; y < n; y++)
+        for (int x = 0; x < n; x++) {
+            if (x + 1 < n)
+                leste[y * n + x] = (y == 0 || y == n - 1) ? 1 + sorteia(borda)
+                                                          : 1 + borda + sorteia(internas);
+            if (y + 1 < n)
+                sul[y * n + x] = (x == 0 || x == n - 1) ? 1 + sorteia(borda)
+                                                        : 1 + borda + sorteia(internas);
+        }
+
+    // Peças na ordem Norte, Leste, Sul, Oeste, como na entrada dos solvers
+    int *pecas = malloc(n * n * 4 * sizeof(int));
+    for (int y = 0; y < n; y++)
+        for (int x = 0; x < n; x++) {
+            int *p = &pecas[(y * n + x) * 4];
+            p[0] = y > 0 ? sul[(y - 1) * n + x] : 0;
+            p[1] = leste[y * n + x];
+            p[2] = sul[y * n + x];
+            p[3] = x > 0 ? leste[y * n + x - 1] : 0;
+        }
+
+    // Embaralha (Fisher-Yates) e gira cada peça
+    for (int i = n * n - 1; i > 0; i--) {
+        int j = sorteia(i + 1);
+        for (int c = 0; c < 4; c++) {
+            int t = pecas[i * 4 + c];
+            pecas[i * 4 + c] = pecas[j * 4 + c];
+            pecas[j * 4 + c] = t;
+        }
+    }
+    if (binario) {
+        fputs("ETB1", stdout);
+        escreve_u32(n);
+        escreve_u32(borda + internas);
+    } else {
+        printf("%d %d\n", n, borda + internas);
+    }
+    for (int i = 0; i < n * n; i++) {
+        int r = sorteia(4);
+        int *p = &pecas[i * 4];
+        if (binario)
+            for (int c = 0; c < 4; c++) putchar(p[(r + c) % 4]);
+        else
+            printf("%d %d %d %d\n", p[r], p[(r + 1) % 4], p[(r + 2) % 4], p[(r + 3) % 4]);
+    }
+
+    free(leste);
+    free(sul);
+    free(pecas);
+    return 0;
+}